@@ -0,0 +1,347 @@
+// Per stage microbenchmarks of the codec
+//
+// Usage: ./microbench [input_size] [file...]
+//
+// Every stage runs on synthetic inputs of 1, 4 and 7 bits of
+// entropy per byte and on the first input_size bytes of the
+// corpus files (ArquivosParaComprimir/ by default). Setup is
+// untimed, each measure is the median of several timed runs.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../include/lz77.h"
+#include "../include/huffman.h"
+#include "../include/bitstream.h"
+
+// Timed runs of a measure and minimum time spent on them
+static const int kMinRuns = 5;
+static const double kMinSeconds = 0.2;
+
+// Positions matched against a full search buffer
+static const uint64_t kMatchPositions = 4096;
+
+// Median seconds of body, setup runs untimed before every run
+static double MedianSeconds(const std::function<void()> &setup,
+                            const std::function<void()> &body)
+{
+  std::vector<double> times;
+  double total = 0;
+
+  while ((int)times.size() < kMinRuns || total < kMinSeconds)
+  {
+    setup();
+
+    auto begin = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+
+    times.push_back(std::chrono::duration<double>(end - begin).count());
+    total += times.back();
+
+    if (times.size() >= 1000)
+    {
+      break;
+    }
+  }
+
+  std::sort(times.begin(), times.end());
+
+  return times[times.size() / 2];
+}
+
+static void Report(const std::string &stage, const std::string &input,
+                   uint64_t n_units, const char *unit, double seconds)
+{
+  printf("%-26s %-20s %10.2f ns/%-6s %10.3f M%s/s\n",
+         stage.c_str(), input.c_str(),
+         seconds * 1e9 / std::max<uint64_t>(n_units, 1), unit,
+         n_units / seconds / 1e6, unit);
+  fflush(stdout);
+}
+
+// Uniform bytes over 2^bits symbols
+static std::string SyntheticInput(int bits, size_t size)
+{
+  std::string content(size, '\0');
+  uint64_t state = 0x9E3779B97F4A7C15ULL + bits;
+
+  for (auto &c : content)
+  {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    c = 'a' + (state >> 32) % (1u << bits);
+  }
+
+  return content;
+}
+
+//! Stage Benchmark class
+/*
+  * Reaches the Encoder internals, so match finding and the
+  * search tree updates are timed apart from Encode
+  */
+class StageBenchmark
+{
+public:
+  static void FillBuffer(const std::string &name, const std::string &content)
+  {
+    LZ77::Encoder *encoder = nullptr;
+
+    double seconds = MedianSeconds(
+        [&]()
+        { delete encoder; encoder = new LZ77::Encoder(); },
+        [&]()
+        { encoder->FillBuffer(content.data(), content.size()); });
+
+    delete encoder;
+    Report("Encoder::FillBuffer", name, content.size(), "B", seconds);
+  }
+
+  // Tree insertions and evictions of a whole content
+  static void UpdateSearchBufferTree(const std::string &name,
+                                     const std::string &content)
+  {
+    LZ77::Encoder *encoder = nullptr;
+
+    double seconds = MedianSeconds(
+        [&]()
+        {
+          delete encoder;
+          encoder = new LZ77::Encoder();
+          encoder->FillBuffer(content.data(), content.size());
+        },
+        [&]()
+        {
+          for (encoder->current_character_index_ = 0;
+               encoder->current_character_index_ < content.size();
+               encoder->current_character_index_++)
+          {
+            encoder->UpdateSearchBufferTree(0);
+          }
+        });
+
+    delete encoder;
+    Report("UpdateSearchBufferTree", name, content.size(), "pos", seconds);
+  }
+
+  // SearchBestMatch and LargestMatch against a full search buffer
+  static void MatchFinding(const std::string &name, const std::string &content)
+  {
+    LZ77::Encoder encoder;
+    uint64_t window = encoder.search_buffer_size_;
+
+    if (content.size() <= window)
+    {
+      return;
+    }
+
+    encoder.FillBuffer(content.data(), content.size());
+
+    for (encoder.current_character_index_ = 0;
+         encoder.current_character_index_ < window;
+         encoder.current_character_index_++)
+    {
+      encoder.UpdateSearchBufferTree(0);
+    }
+
+    uint64_t end = std::min<uint64_t>(content.size(), window + kMatchPositions);
+    uint64_t total_length = 0;
+
+    double seconds = MedianSeconds(
+        []() {},
+        [&]()
+        {
+          for (uint64_t i = window; i < end; i++)
+          {
+            encoder.current_character_index_ = i;
+            encoder.look_ahead_buffer_ =
+                content.substr(i, encoder.look_ahead_buffer_size_);
+
+            LZ77::ArenaString match = encoder.SearchBestMatch();
+
+            if (match != "")
+            {
+              total_length += std::get<1>(encoder.LargestMatch(match));
+            }
+          }
+        });
+
+    Report("SearchBest/LargestMatch", name, end - window, "pos", seconds);
+  }
+};
+
+static void ComputeHuffmanCode(const std::string &name, const std::string &content)
+{
+  // Lengths like symbols, over the content bytes
+  std::vector<int> symbols(content.begin(), content.end());
+  Huffman::Encoder *encoder = nullptr;
+
+  double seconds = MedianSeconds(
+      [&]()
+      {
+        delete encoder;
+        encoder = new Huffman::Encoder();
+        encoder->FillBuffer(symbols);
+        encoder->ComputeProbabilityTable();
+      },
+      [&]()
+      { encoder->ComputeHuffmanCode(); });
+
+  delete encoder;
+  Report("ComputeHuffmanCode", name, 1, "table", seconds);
+}
+
+static void BitstreamBits(const std::string &name, const std::string &content)
+{
+  uint64_t n_bits = content.size() * 8;
+  Bitstream *bstream = nullptr;
+  std::vector<uint8_t> flushed;
+
+  double seconds = MedianSeconds(
+      [&]()
+      { delete bstream; bstream = new Bitstream(); },
+      [&]()
+      {
+        for (unsigned char c : content)
+        {
+          for (int i = 7; i >= 0; i--)
+          {
+            bstream->writeBit((c >> i) & 1);
+          }
+        }
+      });
+
+  Report("Bitstream::writeBit", name, n_bits, "bit", seconds);
+
+  flushed.resize(bstream->flushedSize());
+  bstream->flushesToBuffer(flushed.data(), flushed.size());
+  delete bstream;
+  bstream = nullptr;
+
+  uint64_t ones = 0;
+
+  seconds = MedianSeconds(
+      [&]()
+      {
+        delete bstream;
+        bstream = new Bitstream(flushed.data(), flushed.size());
+      },
+      [&]()
+      {
+        while (bstream->hasBits())
+        {
+          ones += bstream->readBit();
+        }
+      });
+
+  delete bstream;
+  Report("Bitstream::readBit", name, n_bits, "bit", seconds);
+}
+
+static void Decoding(const std::string &name, const std::string &content)
+{
+  std::vector<char> compressed(LZ77::CompressBound(content.size()));
+  size_t compressed_size = LZ77::Compress(content.data(), content.size(),
+                                          compressed.data(), compressed.size());
+  LZ77::Decoder *decoder = nullptr;
+
+  double seconds = MedianSeconds(
+      [&]()
+      {
+        delete decoder;
+        decoder = new LZ77::Decoder();
+        decoder->DecompressFromBuffer(compressed.data(), compressed_size);
+      },
+      [&]()
+      {
+        decoder->Decode("offset");
+        decoder->Decode("length");
+      });
+
+  Report("Decoder::Decode headers", name, 1, "frame", seconds);
+
+  seconds = MedianSeconds(
+      [&]()
+      {
+        delete decoder;
+        decoder = new LZ77::Decoder();
+        decoder->DecompressFromBuffer(compressed.data(), compressed_size);
+        decoder->AllocateOutput();
+        decoder->Decode("offset");
+        decoder->Decode("length");
+      },
+      [&]()
+      { decoder->DecompressLZ77Code(); });
+
+  delete decoder;
+  Report("DecompressLZ77Code", name, content.size(), "B", seconds);
+}
+
+int main(int argc, char *argv[])
+{
+  size_t input_size = 16 << 10;
+  std::vector<std::string> paths;
+  std::vector<std::pair<std::string, std::string>> inputs;
+
+  if (argc > 1)
+  {
+    input_size = std::stoul(argv[1]);
+  }
+
+  for (int i = 2; i < argc; i++)
+  {
+    paths.push_back(argv[i]);
+  }
+
+  if (paths.empty())
+  {
+    for (auto &entry : std::filesystem::directory_iterator("ArquivosParaComprimir"))
+    {
+      paths.push_back(entry.path().string());
+    }
+
+    std::sort(paths.begin(), paths.end());
+  }
+
+  for (int bits : {1, 4, 7})
+  {
+    inputs.emplace_back("entropy " + std::to_string(bits) + " bits",
+                        SyntheticInput(bits, input_size));
+  }
+
+  for (const auto &path : paths)
+  {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    std::string content(input_size, '\0');
+
+    file.read(&content[0], input_size);
+    content.resize(file.gcount());
+
+    if (!content.empty())
+    {
+      inputs.emplace_back(std::filesystem::path(path).filename().string(),
+                          content);
+    }
+  }
+
+  for (const auto &input : inputs)
+  {
+    StageBenchmark::FillBuffer(input.first, input.second);
+    StageBenchmark::UpdateSearchBufferTree(input.first, input.second);
+    StageBenchmark::MatchFinding(input.first, input.second);
+    ComputeHuffmanCode(input.first, input.second);
+    BitstreamBits(input.first, input.second);
+    Decoding(input.first, input.second);
+  }
+
+  return 0;
+}
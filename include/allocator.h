@@ -0,0 +1,330 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace Allocator
+{
+  //! Subsystems
+  /*
+   * Owners the accounted memory is reported by
+  */
+  enum Subsystem
+  {
+    kWindow,
+    kMatchFinder,
+    kTokens,
+    kEntropyTables,
+    kIOBuffers,
+    kSubsystemCount
+  };
+
+  //! Hooks
+  /*
+   * Functions the tracked memory is taken from and
+   * given back to, malloc and free by default
+  */
+  struct Hooks
+  {
+    void *(*allocate)(size_t n, void *context);
+    void (*deallocate)(void *pointer, size_t n, void *context);
+    void *context;
+  };
+
+  //! Usage
+  /*
+   * Current and peak accounted bytes, per
+   * subsystem and of all of them together
+  */
+  struct Usage
+  {
+    uint64_t current[kSubsystemCount];
+    uint64_t peak[kSubsystemCount];
+    uint64_t total_current;
+    uint64_t total_peak;
+    uint64_t budget;
+  };
+
+  //! Subsystem names, as reported
+  extern const char *const kSubsystemNames[kSubsystemCount];
+
+  //! Set Hooks function
+  /*
+   * Replaces the hooks, before any tracked
+   * memory is allocated
+  */
+  void SetHooks(const Hooks &hooks);
+
+  //! Set Budget function
+  /*
+   * Accounted bytes allowed in the whole process,
+   * 0 for no limit. Going over it throws.
+  */
+  void SetBudget(uint64_t budget);
+
+  //! Get Usage function
+  Usage GetUsage();
+
+  //! Charge function
+  /*
+   * Adds n bytes to a subsystem, throws
+   * std::invalid_argument over the budget
+  */
+  void Charge(Subsystem subsystem, uint64_t n);
+
+  //! Release function
+  /*
+   * Removes n bytes from a subsystem
+  */
+  void Release(Subsystem subsystem, uint64_t n);
+
+  //! Allocate function
+  /*
+   * Charges n bytes to a subsystem and takes them from the hooks
+  */
+  void *Allocate(Subsystem subsystem, size_t n);
+
+  //! Deallocate function
+  /*
+   * Gives n bytes back to the hooks and releases them
+  */
+  void Deallocate(Subsystem subsystem, void *pointer, size_t n);
+
+  //! Tracked class
+  /*
+   * Standard allocator going through the hooks,
+   * for the containers owning large buffers
+  */
+  template <typename T, Subsystem S>
+  class Tracked
+  {
+  public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind
+    {
+      typedef Tracked<U, S> other;
+    };
+
+    Tracked() = default;
+
+    template <typename U>
+    Tracked(const Tracked<U, S> &)
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+      return static_cast<T *>(Allocate(S, n * sizeof(T)));
+    }
+
+    void deallocate(T *pointer, size_t n)
+    {
+      Deallocate(S, pointer, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const Tracked<U, S> &) const
+    {
+      return true;
+    }
+
+    template <typename U>
+    bool operator!=(const Tracked<U, S> &) const
+    {
+      return false;
+    }
+  };
+
+  //! Arena class
+  /*
+   * Pool the small blocks of an owner are carved from, in
+   * chunks charged to its subsystem. Freed blocks are kept
+   * on a list per size and reused. Reset forgets every block
+   * at once and keeps the chunks for the next input, so
+   * their owner must have given them all back first.
+   * Blocks over kMaxBlock bytes are taken from the hooks.
+  */
+  class Arena
+  {
+  private:
+    //! Freed block, linked in its size list
+    struct FreeBlock
+    {
+      FreeBlock *next;
+    };
+
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kMaxBlock = 512;
+    static constexpr size_t kMinChunk = 1 << 16;
+    static constexpr size_t kMaxChunk = 1 << 20;
+
+    Subsystem subsystem_;
+
+    //! Chunks taken, their sizes and their total
+    std::vector<std::pair<char *, size_t>> chunks_;
+    size_t capacity_;
+
+    //! Chunk being carved and its bytes carved so far
+    size_t chunk_;
+    size_t used_;
+
+    //! Freed blocks, per size in kGranularity units
+    FreeBlock *free_[kMaxBlock / kGranularity + 1];
+
+    //! Carves n bytes from the chunks, taking a new one when full
+    void *Carve(size_t n);
+
+  public:
+    Arena(Subsystem subsystem);
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+
+    //! Allocate function
+    /*
+     * Takes a block of n bytes, aligned
+     * to kGranularity bytes
+    */
+    void *Allocate(size_t n)
+    {
+      if (n > kMaxBlock)
+      {
+        return Allocator::Allocate(this->subsystem_, n);
+      }
+
+      size_t size_class = (std::max<size_t>(n, 1) + kGranularity - 1) / kGranularity;
+      FreeBlock *block = this->free_[size_class];
+
+      if (block == nullptr)
+      {
+        return this->Carve(size_class * kGranularity);
+      }
+
+      this->free_[size_class] = block->next;
+
+      return block;
+    }
+
+    //! Deallocate function
+    /*
+     * Gives back a block of n bytes
+    */
+    void Deallocate(void *pointer, size_t n)
+    {
+      if (n > kMaxBlock)
+      {
+        Allocator::Deallocate(this->subsystem_, pointer, n);
+        return;
+      }
+
+      size_t size_class = (std::max<size_t>(n, 1) + kGranularity - 1) / kGranularity;
+      FreeBlock *block = static_cast<FreeBlock *>(pointer);
+
+      block->next = this->free_[size_class];
+      this->free_[size_class] = block;
+    }
+
+    //! Reset function
+    /*
+     * Forgets the blocks, keeping the chunks
+    */
+    void Reset();
+
+    //! Chunks bytes
+    size_t Capacity() const
+    {
+      return this->capacity_;
+    }
+  };
+
+  //! Arena Allocator class
+  /*
+   * Standard allocator carving from an Arena, for the
+   * node containers allocating and freeing small blocks
+   * at every position
+  */
+  template <typename T>
+  class ArenaAllocator
+  {
+  public:
+    typedef T value_type;
+
+    Arena *arena;
+
+    ArenaAllocator(Arena *arena)
+        : arena(arena)
+    {
+    }
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other)
+        : arena(other.arena)
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+      return static_cast<T *>(this->arena->Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *pointer, size_t n)
+    {
+      this->arena->Deallocate(pointer, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const
+    {
+      return this->arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const
+    {
+      return this->arena != other.arena;
+    }
+  };
+
+  //! Account class
+  /*
+   * Bytes a subsystem owns through containers that do not
+   * use the hooks, set by their owner from their sizes and
+   * released on destruction
+  */
+  class Account
+  {
+  private:
+    Subsystem subsystem_;
+    uint64_t bytes_;
+
+    //! Charges or releases the difference
+    void Update(uint64_t bytes);
+
+  public:
+    Account(Subsystem subsystem);
+    Account(const Account &other);
+    Account &operator=(const Account &other);
+    ~Account();
+
+    //! Set function
+    /*
+     * Sets the bytes owned, throws over the budget
+    */
+    void Set(uint64_t bytes)
+    {
+      if (bytes != this->bytes_)
+      {
+        this->Update(bytes);
+      }
+    }
+  };
+} // namespace Allocator
+
+#endif
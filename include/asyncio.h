@@ -0,0 +1,86 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <memory>
+
+// io_uring is used where the kernel header exists, through
+// its system calls, with -DLZ77_IO_URING=0 it is left out
+#ifndef LZ77_IO_URING
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define LZ77_IO_URING 1
+#endif
+#endif
+#endif
+
+#ifndef LZ77_IO_URING
+#define LZ77_IO_URING 0
+#endif
+
+namespace AsyncIO
+{
+  //! Operations
+  enum Operation
+  {
+    kRead,
+    kWrite
+  };
+
+  //! Backends
+  enum Backend
+  {
+    kUring,
+    kThread
+  };
+
+  //! Queue class
+  /*
+    * I/O Queue
+    *
+    * Runs reads and writes of a file descriptor in the
+    * background, over a fixed set of buffers given at its
+    * creation, with at most one request per buffer in flight.
+    */
+  class Queue
+  {
+  public:
+    virtual ~Queue();
+
+    //! Submit function
+    /*
+     * Starts reading or writing n bytes at data, inside the
+     * buffer, at offset in the file, -1 for its position
+    */
+    virtual void Submit(int buffer, Operation operation, int fd,
+                        char *data, size_t n, int64_t offset) = 0;
+
+    //! Wait function
+    /*
+     * Waits for the request of a buffer, returns the
+     * bytes read or written, or -errno on error
+    */
+    virtual int64_t Wait(int buffer) = 0;
+
+    //! Backend used
+    virtual Backend GetBackend() const = 0;
+  };
+
+  //! Open function
+  /*
+   * Creates a queue over n_buffers buffers of size bytes,
+   * on io_uring with them registered when the kernel allows
+   * it, on a thread doing the system calls otherwise
+  */
+  std::unique_ptr<Queue> Open(char *const *buffers, int n_buffers, size_t size);
+
+  //! Set Backend function
+  /*
+   * Forces the queues opened from now on to a backend,
+   * kThread to leave io_uring aside
+  */
+  void SetBackend(Backend backend);
+} // namespace AsyncIO
+
+#endif
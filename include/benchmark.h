@@ -0,0 +1,69 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Benchmark
+{
+  //! Default corpus
+  const std::string kDefaultCorpus = "ArquivosParaComprimir";
+
+  //! Settings
+  /*
+   * Timed runs per measure, untimed warm-up runs
+   * before them and the encoder block sizes swept
+  */
+  struct Settings
+  {
+    int iterations = 3;
+    int warmup = 1;
+    std::vector<size_t> block_sizes;
+  };
+
+  //! Result
+  /*
+   * Sizes in bytes and median times in seconds
+   * of a file with a parameter set
+  */
+  struct Result
+  {
+    std::string name;
+    size_t block_size;
+    uint64_t raw_size;
+    uint64_t compressed_size;
+    double compress_seconds;
+    double decompress_seconds;
+    bool round_trip;
+  };
+
+  //! Load Corpus function
+  /*
+   * Reads the files, and the files found in the
+   * directories, to memory. Returns false if one
+   * could not be read.
+  */
+  bool LoadCorpus(const std::vector<std::string> &paths,
+                  std::vector<std::pair<std::string, std::string>> &corpus);
+
+  //! Measure function
+  /*
+   * Compresses and decompresses content in memory, as the
+   * .lz77 frame written by the StreamEncoder with block_size,
+   * and returns the median times of the timed runs
+  */
+  Result Measure(const std::string &name, const std::string &content,
+                 size_t block_size, const Settings &settings);
+
+  //! Run function
+  /*
+   * Measures every corpus file with every parameter set and
+   * prints a line per measure and the totals, as zstd -b does.
+   * Returns false if a file could not be read or round tripped.
+  */
+  bool Run(const std::vector<std::string> &paths, const Settings &settings);
+} // namespace Benchmark
+
+#endif
@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <string>
 
+#include "allocator.h"
+
 enum Bitstream_Mode : uint8_t
 {
 	WRITE = 0,
@@ -28,7 +30,7 @@ enum Bitstream_Reading_Status : uint8_t
 */
 class Bitstream
 {
-	std::vector<uint8_t> data;
+	std::vector<uint8_t, Allocator::Tracked<uint8_t, Allocator::kIOBuffers>> data;
 
 	uint8_t num_buf8; /// number of bits not flushed to data.
 	uint8_t buf8; /// the bits held and not flushed to data.
@@ -42,9 +44,12 @@ class Bitstream
 public:
 	Bitstream();
 	Bitstream(std::string filename);
+	Bitstream(const uint8_t* buffer, uint64_t nbytes);
 	Bitstream(Bitstream& bs2, uint64_t nbits);
 	~Bitstream();
 
+	void reset();
+
 	void writeBit(bool bit);
 
 	void merge(Bitstream bs);
@@ -57,6 +62,9 @@ public:
 
 	void flushesToFile(std::string filename);
 
+	uint64_t flushedSize();
+	uint64_t flushesToBuffer(uint8_t* buffer, uint64_t capacity);
+
 	void flushesToDecompressedFile(std::string filename);
 
 	bool readBit();
@@ -0,0 +1,58 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace Checksum
+{
+  //! XXH64 function
+  /*
+   * 64 bits xxHash of n bytes. Bytes are consumed
+   * in 32 bytes stripes by 4 independent lanes.
+  */
+  uint64_t XXH64(const void *data, size_t n, uint64_t seed = 0);
+
+  //! XXH64 State class
+  /*
+   * Computes the XXH64 of a content
+   * given in several pieces
+  */
+  class XXH64State
+  {
+  private:
+    //! Lanes accumulators
+    uint64_t lanes_[4];
+
+    //! Seed and bytes consumed so far
+    uint64_t seed_;
+    uint64_t total_size_;
+
+    //! Bytes not forming a whole stripe yet
+    uint8_t stripe_[32];
+    size_t stripe_size_;
+
+  public:
+    XXH64State(uint64_t seed = 0);
+
+    //! Reset
+    /*
+     * Starts a new content
+    */
+    void Reset(uint64_t seed = 0);
+
+    //! Update
+    /*
+     * Consumes the next n bytes of the content
+    */
+    void Update(const void *data, size_t n);
+
+    //! Digest
+    /*
+     * Returns the XXH64 of the bytes consumed
+    */
+    uint64_t Digest() const;
+  };
+} // namespace Checksum
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace Dictionary
+{
+  //! Magic number
+  /*
+   * "LZ7D" bytes, first 4 bytes of a dictionary file
+  */
+  const uint32_t kMagic = 0x4C5A3744;
+
+  //! Format version
+  const uint8_t kVersion = 1;
+
+  //! Max size
+  /*
+   * Largest content, the bytes a match offset
+   * reaches back from the message start
+  */
+  const size_t kMaxSize = 0xFFFE;
+
+  //! Default size
+  /*
+   * Dictionary bytes trained by default, the positions
+   * the encoder search buffer holds: older bytes are
+   * never matched
+  */
+  const size_t kDefaultSize = 2048;
+
+  //! Preset dictionary
+  /*
+   * Content pre-filled in the window before each message,
+   * so its matches may reference it, the identifier
+   * compressed messages carry to name it, and optional
+   * default offset and length Huffman codes, as the
+   * Encoder symbol encodes. Messages coded with these
+   * carry no Huffman headers.
+   *
+   * File:
+   *   Magic:        4B
+   *   Version:      1B
+   *   Identifier:   4B
+   *   Content size: 4B
+   *   Content
+   *   Offset table: symbols number (4B), then per symbol
+   *                 (2B,1B,code bytes) -> (symbol,size,code)
+   *   Length table: as the offset table
+  */
+  struct Preset
+  {
+    uint32_t id = 0;
+    std::string content;
+    std::map<std::string, std::string> offset_table;
+    std::map<std::string, std::string> length_table;
+  };
+
+  //! Train Settings
+  /*
+   * Dictionary size, worker threads, and the segment sizes
+   * (k) and d-mer sizes (d) the training chooses from
+  */
+  struct TrainSettings
+  {
+    size_t dictionary_size = kDefaultSize;
+    unsigned threads = 1;
+    std::vector<size_t> segment_sizes = {64, 128, 256, 512};
+    std::vector<size_t> dmer_sizes = {6, 8};
+  };
+
+  //! Compute Id function
+  /*
+   * Identifier of a content, from its XXH64,
+   * never 0 which marks no dictionary
+  */
+  uint32_t ComputeId(const void *content, size_t n);
+
+  //! Create function
+  /*
+   * Makes a dictionary from n bytes, keeping the last
+   * kMaxSize ones, the most recent samples
+  */
+  Preset Create(const void *content, size_t n);
+
+  //! Serialize function
+  /*
+   * Appends the dictionary file bytes to output
+  */
+  void Serialize(const Preset &preset, std::vector<uint8_t> &output);
+
+  //! Parse function
+  /*
+   * Reads a dictionary from the n bytes of a file. Throws
+   * std::invalid_argument if they are not a dictionary.
+  */
+  Preset Parse(const uint8_t *bytes, size_t n);
+
+  //! Load function
+  /*
+   * Reads the dictionary file at file_path
+  */
+  Preset Load(std::string file_path);
+
+  //! Save function
+  /*
+   * Writes the dictionary to file_path
+  */
+  void Save(const Preset &preset, std::string file_path);
+
+  //! Train function
+  /*
+   * Builds a dictionary from samples, as COVER does: the
+   * samples are split in epochs and the segment of k bytes
+   * whose distinct d-mers are the most frequent over all the
+   * samples is taken from each, until the dictionary is full.
+   * Each (k, d) pair is tried by a worker and the dictionary
+   * compressing held-out samples best is kept. Its default
+   * tables are built from the samples compressed with it.
+   * Throws std::invalid_argument without samples.
+  */
+  Preset Train(const std::vector<std::string> &samples,
+               const TrainSettings &settings);
+} // namespace Dictionary
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef FDSTREAM_H
+#define FDSTREAM_H
+
+#include <streambuf>
+#include <vector>
+#include <cstddef>
+#include <memory>
+
+#include "allocator.h"
+#include "asyncio.h"
+
+namespace FdStream
+{
+  //! Default buffer size
+  /*
+   * Large enough for a whole encoder block, so
+   * pipes are read and written in few syscalls
+  */
+  const size_t kBufferSize = 1 << 20;
+
+  //! File Descriptor Stream Buffer class
+  /*
+    * Stream Buffer
+    *
+    * Reads or writes a file descriptor, such as stdin, stdout
+    * or an open file, through two large buffers and an I/O
+    * queue: the next buffer is read ahead while the stream
+    * consumes one, and a full buffer is written behind while
+    * the stream fills the other. Errors are reported as the
+    * usual end of file or failed write.
+    */
+  class FdStreamBuf : public std::streambuf
+  {
+  private:
+    typedef std::vector<char, Allocator::Tracked<char, Allocator::kIOBuffers>> Buffer;
+
+    //! Directions, decided by the first use
+    enum Mode
+    {
+      kIdle,
+      kReading,
+      kWriting
+    };
+
+    //! File descriptor
+    int fd_;
+
+    //! Whether the descriptor is closed with the buffer
+    bool owns_fd_;
+
+    //! Buffers
+    /*
+     * The one the stream uses, with the bytes read and not
+     * consumed yet or written and not flushed yet, and the
+     * one the queue is reading or writing
+    */
+    Buffer buffers_[2];
+
+    //! Buffer used by the stream
+    int current_;
+
+    //! I/O queue over the buffers
+    std::unique_ptr<AsyncIO::Queue> queue_;
+
+    //! Requests in flight, per buffer
+    bool in_flight_[2];
+
+    //! Bytes of the buffer written so far and to write
+    size_t written_[2];
+    size_t to_write_[2];
+
+    //! Offset of the next request, -1 when the descriptor can not seek
+    int64_t offset_;
+
+    Mode mode_;
+    bool end_of_file_;
+    bool failed_;
+
+    //! Submit function
+    /*
+     * Starts reading or writing the buffer from its
+     * written bytes, at the offset reached so far
+    */
+    void Submit(int buffer, AsyncIO::Operation operation);
+
+    //! Wait Read function
+    /*
+     * Waits for the read of a buffer, returns the bytes
+     * read, 0 at the end of the input or on error
+    */
+    size_t WaitRead(int buffer);
+
+    //! Wait Write function
+    /*
+     * Waits for the write of a buffer, resubmitting the rest
+     * of short writes, returns false on error
+    */
+    bool WaitWrite(int buffer);
+
+    //! Flush Buffer
+    /*
+     * Writes the pending bytes behind, returns false on error
+    */
+    bool FlushBuffer();
+
+  protected:
+    int_type underflow() override;
+    int_type overflow(int_type c) override;
+    int sync() override;
+    std::streamsize xsgetn(char *bytes, std::streamsize n) override;
+    std::streamsize xsputn(const char *bytes, std::streamsize n) override;
+
+  public:
+    FdStreamBuf(int fd, size_t buffer_size = kBufferSize, bool owns_fd = false);
+    ~FdStreamBuf();
+
+    //! Close function
+    /*
+     * Waits for the pending writes and closes the
+     * descriptor, returns false if anything failed
+    */
+    bool Close();
+  };
+} // namespace FdStream
+
+#endif
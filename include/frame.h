@@ -0,0 +1,176 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace Frame
+{
+  //! Magic number
+  /*
+   * "LZ77" bytes, first 4 bytes of every frame
+  */
+  const uint32_t kMagic = 0x4C5A3737;
+
+  //! Format version
+  const uint8_t kVersion = 1;
+
+  //! Frame flags
+  enum Frame_Flags : uint8_t
+  {
+    kBlockIndex = 0x01,      /// a block index follows the end mark
+    kContentChecksum = 0x02, /// blocks and frame content checksums
+    kDictionary = 0x04       /// restart blocks follow a preset dictionary
+  };
+
+  //! Block flags
+  enum Block_Flags : uint8_t
+  {
+    kReuseTables = 0x01, /// the previous block Huffman tables are reused
+    kRestart = 0x02      /// restart point, no previous block is referenced
+  };
+
+  //! Headers sizes in bytes
+  const size_t kFrameHeaderSize = 10;
+  const size_t kDictionaryIdSize = 4;
+  const size_t kBlockHeaderSize = 9;
+  const size_t kChecksumSize = 8;
+  const size_t kEndMarkSize = 4;
+  const size_t kIndexEntrySize = 16;
+  const size_t kIndexTrailerSize = 8;
+
+  //! Frame header
+  /*
+   * Magic:      4B
+   * Version:    1B
+   * Flags:      1B
+   * Block size: 4B -> largest block raw size
+   * Dictionary: 4B -> identifier of the preset dictionary, with kDictionary
+   *
+   * With kDictionary, every restart block matches may reference
+   * the dictionary content, as if it preceded the block.
+  */
+  struct FrameHeader
+  {
+    uint8_t version;
+    uint8_t flags;
+    uint32_t block_size;
+    uint32_t dictionary_id = 0;
+  };
+
+  //! Block header
+  /*
+   * Raw size:        4B -> 0 marks the frame end, no other field follows
+   * Compressed size: 4B -> payload bytes after the header
+   * Flags:           1B
+   * Checksum:        8B -> XXH64 of the raw block, with kContentChecksum
+   *
+   * The payload is a bitstream with the offset and length
+   * Huffman headers, unless kReuseTables is set, and the triples.
+   *
+   * With kContentChecksum the end mark is followed by the frame
+   * checksum (8B): the XXH64 of the blocks checksums, each one
+   * as 8B big endian, so blocks can be verified independently.
+  */
+  struct BlockHeader
+  {
+    uint32_t raw_size;
+    uint32_t compressed_size;
+    uint8_t flags;
+    uint64_t checksum;
+  };
+
+  //! Block index entry
+  /*
+   * One entry per restart block:
+   * Raw offset:        8B -> block first byte in the original content
+   * Compressed offset: 8B -> block header position in the frame
+   *
+   * The index is written after the end mark as its entries
+   * followed by the trailer: entries number (4B) and the
+   * index size in bytes (4B), so it can be read from the end.
+  */
+  struct IndexEntry
+  {
+    uint64_t raw_offset;
+    uint64_t compressed_offset;
+  };
+
+  //! Write Uint function
+  /*
+   * Appends the n_bytes lowest bytes
+   * of value, big endian, to output
+  */
+  void WriteUint(uint64_t value, int n_bytes, std::vector<uint8_t> &output);
+
+  //! Read Uint function
+  /*
+   * Reads a n_bytes big endian value
+  */
+  uint64_t ReadUint(const uint8_t *bytes, int n_bytes);
+
+  //! Frame Header Size function
+  /*
+   * Frame header bytes with flags
+  */
+  size_t FrameHeaderSize(uint8_t flags);
+
+  //! Write Frame Header function
+  void WriteFrameHeader(const FrameHeader &header, std::vector<uint8_t> &output);
+
+  //! Parse Frame Header function
+  /*
+   * Reads the first kFrameHeaderSize bytes of a header,
+   * the dictionary identifier is read by ParseDictionaryId.
+   * Throws std::invalid_argument if the magic number or
+   * the version do not match.
+  */
+  FrameHeader ParseFrameHeader(const uint8_t *bytes);
+
+  //! Parse Dictionary Id function
+  /*
+   * Reads the kDictionaryIdSize bytes following the first
+   * kFrameHeaderSize ones of a header with kDictionary
+  */
+  uint32_t ParseDictionaryId(const uint8_t *bytes);
+
+  //! Block Header Size function
+  /*
+   * Block header bytes in a frame with frame_flags
+  */
+  size_t BlockHeaderSize(uint8_t frame_flags);
+
+  //! Write Block Header function
+  void WriteBlockHeader(const BlockHeader &header, uint8_t frame_flags,
+                        std::vector<uint8_t> &output);
+
+  //! Parse Block Header function
+  /*
+   * Reads a header of BlockHeaderSize(frame_flags) bytes
+  */
+  BlockHeader ParseBlockHeader(const uint8_t *bytes, uint8_t frame_flags);
+
+  //! Frame Checksum function
+  /*
+   * Combines the blocks checksums into the frame checksum
+  */
+  uint64_t FrameChecksum(const std::vector<uint64_t> &block_checksums);
+
+  //! Write End Mark function
+  void WriteEndMark(std::vector<uint8_t> &output);
+
+  //! Write Index function
+  /*
+   * Appends the index entries and its trailer
+  */
+  void WriteIndex(const std::vector<IndexEntry> &index, std::vector<uint8_t> &output);
+
+  //! Parse Index function
+  /*
+   * Reads n_entries index entries
+  */
+  std::vector<IndexEntry> ParseIndex(const uint8_t *bytes, size_t n_entries);
+} // namespace Frame
+
+#endif
@@ -9,6 +9,7 @@
 #include <stack>
 #include <iterator>
 #include <cmath>
+#include <stdint.h>
 
 namespace Huffman
 {
@@ -34,7 +35,7 @@ namespace Huffman
     /*
      * Counts how many characters exists on the source
     */
-    int character_counter_;
+    uint64_t character_counter_ = 0;
 
     //! Largest code size
     /*
@@ -74,7 +75,7 @@ namespace Huffman
     /*
      * Increases n_characters on the character_counter variable.
     */
-    void CountCharacters(int n_characters);
+    void CountCharacters(uint64_t n_characters);
 
     //! Fill stream
     /*
@@ -88,6 +89,12 @@ namespace Huffman
     */
     void FillBuffer(std::vector<int> buffer);
 
+    //! Fill stream
+    /*
+     * Fill the Coder buffer with n 16 bits symbols
+    */
+    void FillBuffer(const uint16_t *buffer, size_t n);
+
     //! Fill stream
     /*
      * Fill the Coder buffer with a buffer
@@ -99,14 +106,14 @@ namespace Huffman
      * Returns the number of characters from read
      * from the file
     */
-    int HowManyCharacters();
+    uint64_t HowManyCharacters();
 
     //! Characters quantity
     /*
      * Returns the number of characters from read
      * from the file
     */
-    int CharactersQuantity();
+    uint64_t CharactersQuantity();
 
     //! Get buffer
     /*
@@ -213,7 +220,7 @@ namespace Huffman
      * Express the current bit 
      * read from the compressed file
     */
-    int current_bit_;
+    uint64_t current_bit_;
 
     //! Encoded Content Buffer
     /*
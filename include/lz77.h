@@ -10,17 +10,136 @@
 #include <set>
 #include <tuple>
 #include <map>
+#include <deque>
+#include <memory>
+#include <exception>
+#include <string_view>
+#include <thread>
+#include <stdint.h>
+
+#include "frame.h"
+#include "dictionary.h"
+#include "checksum.h"
+#include "allocator.h"
+#include "threadpool.h"
+
+class Bitstream;
+class StageBenchmark;
 
 namespace LZ77
 {
-  struct triple_struct
+  //! Max offset
+  /*
+   * Largest offset sent in a triple. Offsets are 16 bits
+   * symbols and the offset header counts them in 16 bits,
+   * so the 0 to kMaxOffset alphabet must fit in it.
+   * Farther matches are sent as literals.
+  */
+  const uint64_t kMaxOffset = 0xFFFE;
+
+  //! Wild copy slack
+  /*
+   * Bytes after a match that CopyMatch may overwrite,
+   * output buffers hold them past the content end
+  */
+  const size_t kWildCopySlack = 16;
+
+  //! Search buffer size
+  /*
+   * Positions the encoder search buffer tree holds,
+   * so the farthest a match offset reaches back
+  */
+  const int kSearchBufferSize = 2048;
+
+  //! Look ahead buffer size
+  /*
+   * Longest match, as its length is sent in a byte
+  */
+  const int kLookAheadBufferSize = 255;
+
+  //! Token Buffer class
+  /*
+    * Triples of a block
+    *
+    * Stores each field in its own array, offsets and lengths
+    * as the 16 bits symbols the Huffman codes are built from
+    * and the literals as bytes, 5 bytes per triple. The
+    * arrays are sized once for the block.
+    */
+  class TokenBuffer
+  {
+  public:
+    template <typename T>
+    using Array = std::vector<T, Allocator::Tracked<T, Allocator::kTokens>>;
+
+    Array<uint16_t> offsets;
+    Array<uint16_t> lengths;
+    Array<uint8_t> literals;
+
+    //! Reserve function
+    /*
+     * Sizes the arrays for n triples
+    */
+    void Reserve(size_t n);
+
+    //! Clear function
+    /*
+     * Empties the arrays, keeping their capacity
+    */
+    void Clear();
+
+    //! Triples number
+    size_t Size() const
+    {
+      return this->literals.size();
+    }
+
+    //! Push function
+    /*
+     * Appends a triple
+    */
+    void Push(uint16_t offset, uint16_t length, uint8_t literal)
+    {
+      this->offsets.push_back(offset);
+      this->lengths.push_back(length);
+      this->literals.push_back(literal);
+    }
+  };
+
+  //! Code Table class
+  /*
+   * Huffman codes indexed by symbol: the code of a symbol
+   * is the sizes[symbol] low bits of codes[symbol], the
+   * first sent the most significant. Codes take 1 bit at
+   * least, a size of 0 means the symbol has no code.
+  */
+  class CodeTable
   {
-    int offset;
-    int length;
-    std::string codeword;
+  public:
+    std::vector<uint64_t> codes;
+    std::vector<uint8_t> sizes;
+
+    //! Assign function
+    /*
+     * Fills the table from a symbol to code map, as
+     * Huffman::Encoder::GetSymbolEncode returns
+    */
+    void Assign(const std::map<std::string, std::string> &symbol_encode);
+
+    //! Has function
+    bool Has(uint16_t symbol) const
+    {
+      return symbol < this->sizes.size() && this->sizes[symbol] != 0;
+    }
   };
 
-  typedef triple_struct triple_struct;
+  //! Arena String
+  /*
+   * Search buffer sequence, carved from the encoder arena
+  */
+  typedef std::basic_string<char, std::char_traits<char>,
+                            Allocator::ArenaAllocator<char>>
+      ArenaString;
 
   //! Encoder class
   /*
@@ -32,6 +151,22 @@ namespace LZ77
   class Encoder
   {
   private:
+    //! Match finder arena
+    /*
+     * The search tree nodes, the positions map nodes and
+     * their sequences are carved from it, it outlives them
+    */
+    Allocator::Arena arena_{Allocator::kMatchFinder};
+    Allocator::ArenaAllocator<char> allocator_{&arena_};
+
+    //! Dictionary arena
+    /*
+     * The nodes seeded from the preset dictionary,
+     * kept over Reset until the dictionary changes
+    */
+    Allocator::Arena preset_arena_{Allocator::kMatchFinder};
+    Allocator::ArenaAllocator<char> preset_allocator_{&preset_arena_};
+
     //! Log values to print
     /*
      * Entropy and average bits per symbol rate
@@ -39,11 +174,13 @@ namespace LZ77
     double entropy_;
     double average_rate_;
 
-    //!
+    //! Tokens
     /*
-     * Maps a symbol to its probability
+     * Triples produced on LZ77 encoding, the offset
+     * and length sequences the Huffman codes are
+     * built from and the literals sent with them
     */
-    std::vector<triple_struct> triples_vector_;
+    TokenBuffer tokens_;
 
     //! Symbol Table
     /*
@@ -53,12 +190,21 @@ namespace LZ77
     */
     std::map<std::string, double> symbol_table_;
 
+    //! Symbol Table ready
+    /*
+     * Whether symbol_table_ holds the current content
+     * statistics, computed on the first GetSymbolTable
+    */
+    bool symbol_table_ready_ = false;
+
     //! File string stream
     /* Stores the sequence string index position in the file content.
      * This sequence is one the all possible sequences inside the
      * search buffer, as known as the binary search tree node.
      */
-    std::map<std::string, int> sequence_position_;
+    std::map<ArenaString, uint64_t, std::less<ArenaString>,
+             Allocator::ArenaAllocator<std::pair<const ArenaString, uint64_t>>>
+        sequence_position_;
 
     //! File string stream
     /*
@@ -67,64 +213,76 @@ namespace LZ77
     */
     std::string file_content_;
 
+    //! History size
+    /*
+     * Bytes at the file_content_ beginning already
+     * sent, only referenced by the matches
+    */
+    uint64_t history_size_ = 0;
+
     //! File content encoded
     /*
      * Sequence of output triple: offset, length and symbol
     */
     std::string output_encoding_;
 
-    //! Offset sequence buffer
+    //! Offset Symbol Encode
     /*
-     * Sequence of offsets produced on LZ77 encoding
+     * Maps the offset symbol to its Huffman code
     */
-    std::vector<int> offset_sequence_buffer_;
+    std::map<std::string, std::string> offset_symbol_encode_;
 
-    //! Length sequence buffer
+    //! Length Symbol Encode
     /*
-     * Sequence of lengths produced on LZ77 encoding
+     * Maps the length symbol to its Huffman code
     */
-    std::vector<int> length_sequence_buffer_;
+    std::map<std::string, std::string> length_symbol_encode_;
 
-    //! Symbols sequence buffer
+    //! Code tables
     /*
-     * Sequence of symbols sent on LZ77 triples
+     * Offset and length codes the triples are written with,
+     * indexed by symbol, and the ones of the dictionary
     */
-    std::vector<std::string> codeword_sequence_buffer_;
+    CodeTable offset_codes_;
+    CodeTable length_codes_;
+    CodeTable dictionary_offset_codes_;
+    CodeTable dictionary_length_codes_;
 
     //! File string stream
     /*
      * Its the list of all nodes to be deleted, preserving
      * the nodes insertion order
     */
-    std::vector<std::string> nodes_to_exclude;
+    std::deque<ArenaString, Allocator::Tracked<ArenaString, Allocator::kMatchFinder>>
+        nodes_to_exclude;
 
     //! Search buffer size
     /*
      *  Search buffer size value used especially
      *  in the encoding process
     */
-    const int search_buffer_size_ = 2048;
+    const int search_buffer_size_ = kSearchBufferSize;
 
     //! Look Ahead Buffer
     /*
      *  Look ahead buffer size value used especially
      *  in the encoding process  
     */
-    const int look_ahead_buffer_size_ = 255;
+    const int look_ahead_buffer_size_ = kLookAheadBufferSize;
 
     //! Match position
     /*
      *  Indicates the file's index position
      *  where occurs the match 
     */
-    int match_position_;
+    uint64_t match_position_;
 
     //! Current charater index
     /*
      *  Its the current index in the file_content_ 
      *  buffer
     */
-    int current_character_index_;
+    uint64_t current_character_index_;
 
     // Look ahead buffer consulted on
     // symbols sequence matching
@@ -132,28 +290,91 @@ namespace LZ77
 
     // Search buffer consulted on
     // symbols sequence matching
-    std::multiset<std::string> search_buffer_tree_;
+    std::multiset<ArenaString, std::less<ArenaString>,
+                  Allocator::ArenaAllocator<ArenaString>>
+        search_buffer_tree_;
+
+    //! Preset dictionary
+    /*
+     * Content put before every content given to FillBuffer,
+     * and whether the current one follows it
+    */
+    Dictionary::Preset dictionary_;
+    bool dictionary_history_ = false;
+
+    //! Seeded match finder
+    /*
+     * Search buffer tree, sequence positions and nodes order
+     * seeded from the dictionary alone, once. Encode copies
+     * them instead of inserting the dictionary positions
+     * again, so a small content costs as without it.
+    */
+    std::multiset<ArenaString, std::less<ArenaString>,
+                  Allocator::ArenaAllocator<ArenaString>>
+        preset_tree_;
+    std::map<ArenaString, uint64_t, std::less<ArenaString>,
+             Allocator::ArenaAllocator<std::pair<const ArenaString, uint64_t>>>
+        preset_positions_;
+    std::deque<ArenaString, Allocator::Tracked<ArenaString, Allocator::kMatchFinder>>
+        preset_nodes_;
+
+    //! Seed Search Buffer Tree
+    /*
+     * Inserts the history positions the search
+     * buffer tree can hold, before encoding
+    */
+    void SeedSearchBufferTree();
+
+    //! Memory accounts
+    /*
+     * Bytes of the content and of the Huffman
+     * tables, estimated from the containers sizes
+    */
+    Allocator::Account window_account_{Allocator::kWindow};
+    Allocator::Account tables_account_{Allocator::kEntropyTables};
+
+    //! Drives the encoder stages one at a time (bench/)
+    friend class ::StageBenchmark;
 
   public:
+    Encoder();
+
+    //! Reset function
+    /*
+     * Forgets the content, the search buffer, the triples and
+     * the tables, keeping the buffers and the arena chunks
+     * for the next content
+    */
+    void Reset();
+
+    //! Set Dictionary
+    /*
+     * Puts the preset dictionary before every content given to
+     * FillBuffer without history, so matches may reference it,
+     * and seeds the match finder from it. The compressed content
+     * carries its identifier. An empty dictionary removes it.
+    */
+    void SetDictionary(const Dictionary::Preset &dictionary);
+
     //! characters counter
     /*
      * Increases n_characters on the character_counter variable.
     */
-    void CountCharacters(int n_characters);
+    void CountCharacters(uint64_t n_characters);
 
     //! How many Characters
     /*
      * Returns the number of characters from read
      * from the file
     */
-    int HowManyCharacters();
+    uint64_t HowManyCharacters();
 
     //! Characters quantity
     /*
      * Returns the number of characters from read
      * from the file
     */
-    int CharactersQuantity();
+    uint64_t CharactersQuantity();
 
     //! Fill stream
     /*
@@ -161,6 +382,28 @@ namespace LZ77
     */
     void FillBuffer(std::string file_path);
 
+    //! Fill stream
+    /*
+     * Fill the Coder buffer with n bytes from a memory buffer
+    */
+    void FillBuffer(const void *source, size_t n);
+
+    //! Fill stream
+    /*
+     * Fill the Coder buffer with n bytes from a memory buffer
+     * following history_size bytes already sent. Only the n
+     * bytes are encoded, matches may reference the history.
+    */
+    void FillBuffer(const void *history, size_t history_size,
+                    const void *source, size_t n);
+
+    //! Get Block
+    /*
+     * Returns the bytes encoded, the content
+     * given to FillBuffer after the history
+    */
+    std::string_view GetBlock() const;
+
     //! Count Symbol
     /*
      * Count the read symbol in the symbol_table
@@ -169,15 +412,16 @@ namespace LZ77
 
     //! Get Symbol Table
     /*
-     * Returns Symbol Table
+     * Returns Symbol Table, computing it
+     * on the first call after FillBuffer
     */
     std::map<std::string, double> GetSymbolTable();
 
     //! Computes probability table
     /*
-     * This function computes the probability table 
-     * from of the symbol table after populate it with its
-     * counting in the source input file.
+     * This function computes the probability table
+     * of the bytes to encode with a single pass
+     * of byte histograms over the content.
     */
     void ComputeProbabilityTable();
 
@@ -216,7 +460,7 @@ namespace LZ77
      * Seeks on the search buffer matching sequences
      * with current encoding character in the lookahead buffer
     */
-    std::tuple<int, int> LargestMatch(std::string match_string);
+    std::tuple<int, int> LargestMatch(const ArenaString &match_string);
 
     //! Flush Probability Table As CSV
     /*
@@ -232,6 +476,10 @@ namespace LZ77
      * compressed file .lz77
      * 
      * Header:
+     *   Original size: 8B -> top bit set when the dictionary identifier follows,
+     *                        the next one when the dictionary tables are used
+     *   Dictionary id: 4B -> with the top bit only
+     *
      *   === Offset Huffman header ===
      *   Symbol number: 2B
      *   Tuples: (1B,1B,symboll_size) -> (symbol,size,code)
@@ -240,18 +488,94 @@ namespace LZ77
      *   Symbol number: 2B
      *   Tuples: (1B,1B,symboll_size) -> (symbol,size,code)
      *
+     *   Both Huffman headers are left out when the
+     *   dictionary tables are used
+     *
      * Content:
      *   Triples -> (offset_size, length_size, 1B) -> (offset, length, symbol)
      *   
     */
     void CompressToFile(std::string file_path);
 
+    //! Compress to bitstream
+    /*
+     * Writes the same content as CompressToFile
+     * to a bitstream in memory
+    */
+    void CompressToBitstream(Bitstream &bstream);
+
+    //! Compute Tables
+    /*
+     * Computes the offset and length Huffman codes
+     * from the triples produced by Encode
+    */
+    void ComputeTables();
+
+    //! Set Tables
+    /*
+     * Uses the given offset and length Huffman codes,
+     * as the ones computed for a previous block. Only
+     * the triples are written with them, not the headers.
+    */
+    void SetTables(const CodeTable &offset_codes, const CodeTable &length_codes);
+
+    //! Get Offset Codes
+    /*
+     * Returns the offset Huffman codes
+    */
+    const CodeTable &GetOffsetCodes() const;
+
+    //! Get Length Codes
+    /*
+     * Returns the length Huffman codes
+    */
+    const CodeTable &GetLengthCodes() const;
+
+    //! Tables Size
+    /*
+     * Returns the bits WriteTables writes
+    */
+    uint64_t TablesSize();
+
+    //! Triples Size
+    /*
+     * Returns the bits the triples take with the given
+     * Huffman codes, or UINT64_MAX if a symbol has no code
+    */
+    uint64_t TriplesSize(const CodeTable &offset_codes,
+                         const CodeTable &length_codes) const;
+
+    //! Write Tables
+    /*
+     * Writes the offset and length Huffman headers
+    */
+    void WriteTables(Bitstream &bstream);
+
+    //! Write Triples
+    /*
+     * Writes each triple as (offset code, length code, 1B symbol)
+     * with the current codes, which must code every symbol
+    */
+    void WriteTriples(Bitstream &bstream);
+
+    //! Get Tokens
+    /*
+     * Returns the triples Encode produced
+    */
+    const TokenBuffer &GetTokens() const;
+
     //! Search Best Match
     /*
      * Search on tree the best sequence match
      * to the current lookahead buffer
     */
-    std::string SearchBestMatch();
+    ArenaString SearchBestMatch();
+
+    //! Account Tables
+    /*
+     * Charges the Huffman tables bytes
+    */
+    void AccountTables();
   };
 
   //! Decoder class
@@ -269,7 +593,7 @@ namespace LZ77
      * Express the current bit 
      * read from the compressed file
     */
-    int current_bit_;
+    uint64_t current_bit_;
 
     //! Encoded Content Buffer
     /*
@@ -279,9 +603,53 @@ namespace LZ77
 
     //! Decompressed file buffer
     /*
-     * Out decompressed file buffer
+     * Out decompressed file buffer, allocated with the
+     * original size read from the header when no
+     * output is given by SetOutput
+    */
+    std::vector<uint8_t> decompressed_content_buffer;
+
+    //! Output
+    /*
+     * Bytes the content is decoded to, the caller
+     * buffer or decompressed_content_buffer, and
+     * how many of them may be written
+    */
+    uint8_t *output_ = nullptr;
+    uint64_t output_capacity_ = 0;
+
+    //! Original size
+    /*
+     * Decompressed content size in bytes,
+     * read from the .lz77 header
+    */
+    uint64_t original_size_;
+
+    //! Preset dictionary
+    /*
+     * Dictionary the contents naming its identifier
+     * reference, and the bytes of it put before the
+     * current content in the decompressed buffer
     */
-    std::vector<bool> decompressed_content_buffer;
+    Dictionary::Preset dictionary_;
+    uint64_t dictionary_size_ = 0;
+
+    //! Dictionary tables
+    /*
+     * Code to symbol translations of the dictionary tables,
+     * and whether the current content uses them instead
+     * of the tables of its header
+    */
+    std::map<std::string, std::string> dictionary_offset_codes_;
+    std::map<std::string, std::string> dictionary_length_codes_;
+    bool dictionary_tables_ = false;
+
+    //! Output position
+    /*
+     * Next byte to be written, counting the
+     * dictionary bytes put before the output
+    */
+    uint64_t output_position_;
 
     //! Offset Code to symbol
     /*
@@ -306,6 +674,42 @@ namespace LZ77
     */
     void DecompressFromFile(std::string file_path);
 
+    //! Decompress from Buffer function
+    /*
+     * Reads n bytes of a .lz77 content held in memory
+     * to encoded_content_buffer_
+    */
+    void DecompressFromBuffer(const void *source, size_t n);
+
+    //! Decode Original Size
+    /*
+     * Reads the 8 bytes original size from the header,
+     * nothing is allocated from it
+    */
+    void DecodeOriginalSize();
+
+    //! Set Output
+    /*
+     * Decodes the content straight to destination, whose
+     * capacity must hold the original size
+    */
+    void SetOutput(void *destination, size_t capacity);
+
+    //! Allocate Output
+    /*
+     * Decodes the content to the decompressed_content_buffer,
+     * allocated with the original size. Throws
+     * std::invalid_argument if the size is more than
+     * the content bits can code.
+    */
+    void AllocateOutput();
+
+    //! Get Original Size
+    /*
+     * Returns the decompressed content size
+    */
+    uint64_t GetOriginalSize();
+
     //! Decode
     /*
      * Gets the encoded_content_buffer_ bits and 
@@ -327,8 +731,705 @@ namespace LZ77
      * to a output file 
     */
     void DecompressToFile(std::string file_name);
+
+    //! Decompress to Buffer function
+    /*
+     * Writes the decompressed_content_buffer to a memory
+     * buffer. Returns the number of bytes written, or 0
+     * if they do not fit in the capacity.
+    */
+    size_t DecompressToBuffer(void *destination, size_t capacity);
+
+    //! Reset function
+    /*
+     * Forgets the content read and decoded, keeping
+     * the buffers and the dictionary for the next content
+    */
+    void Reset();
+
+    //! Set Dictionary
+    /*
+     * Dictionary the contents compressed with it reference,
+     * checked against the identifier they carry
+    */
+    void SetDictionary(const Dictionary::Preset &dictionary);
+  };
+
+  //! Stream Decoder class
+  /*
+    * Stream Decoder
+    *
+    * Decompresses a .lz77 frame read incrementally from
+    * an input stream, flushing the output as it goes. Only
+    * the last kMaxOffset bytes, the ones matches can
+    * reference, are kept in memory.
+    */
+  class StreamDecoder
+  {
+  private:
+    //! Input stream
+    /*
+     * Stream the .lz77 content is read from
+    */
+    std::istream *input_;
+
+    //! Input buffer
+    /*
+     * Chunk of the .lz77 content read from the input
+    */
+    std::vector<uint8_t> input_buffer_;
+
+    //! Input position
+    /*
+     * Next byte to be read in the input_buffer_
+     * and number of valid bytes in it
+    */
+    size_t input_position_;
+    size_t input_size_;
+
+    //! Bit buffer
+    /*
+     * Byte being read and the number
+     * of its bits not read yet
+    */
+    uint8_t bit_buffer_;
+    int bit_count_;
+
+    //! Offset Code to symbol
+    /*
+     * Huffman's code to symbol translation
+     * In: (code size, code) Out: Original Symbol
+    */
+    std::map<std::pair<int, uint64_t>, int> offset_code_to_symbol_;
+
+    //! Length Code to symbol
+    /*
+     * Huffman's code to symbol translation
+     * In: (code size, code) Out: Original Symbol
+    */
+    std::map<std::pair<int, uint64_t>, int> length_code_to_symbol_;
+
+    //! Tables account
+    /*
+     * Bytes of the code to symbol maps
+    */
+    Allocator::Account tables_account_{Allocator::kEntropyTables};
+
+    //! Window
+    /*
+     * Sliding output buffer. Holds the last decoded bytes
+     * that matches can reference plus the bytes not
+     * flushed to the output yet.
+    */
+    std::vector<uint8_t, Allocator::Tracked<uint8_t, Allocator::kWindow>> window_;
+
+    //! Window positions
+    /*
+     * Next byte to be written in the window_ and
+     * first byte not flushed to the output yet
+    */
+    size_t window_position_;
+    size_t flushed_position_;
+
+    //! Stream counters
+    /*
+     * Bytes read from the input and original content
+     * position of the next decoded byte
+    */
+    uint64_t bytes_read_;
+    uint64_t decoded_size_;
+
+    //! Raw positions
+    /*
+     * Original content position of the window_ first
+     * byte and of the last restart point decoded
+    */
+    uint64_t window_raw_offset_;
+    uint64_t restart_raw_offset_;
+
+    //! Output range
+    /*
+     * Original content range written to the output,
+     * bytes outside it are decoded and dropped
+    */
+    uint64_t range_begin_;
+    uint64_t range_end_;
+
+    //! Block size
+    /*
+     * Largest block raw size, from the frame header
+    */
+    uint64_t block_size_;
+
+    //! Has tables
+    /*
+     * Whether a block already sent the Huffman
+     * tables a kReuseTables block refers to
+    */
+    bool has_tables_;
+
+    //! Frame flags
+    /*
+     * Flags of the frame header, they select
+     * the block header fields
+    */
+    uint8_t frame_flags_;
+
+    //! Block checksum
+    /*
+     * XXH64 state of the block being decoded and the
+     * first window_ byte not consumed by it yet
+    */
+    Checksum::XXH64State block_state_;
+    size_t hashed_position_;
+
+    //! Preset dictionary
+    /*
+     * Dictionary the frames naming its identifier reference,
+     * and the bytes of it put before each restart block of
+     * the current frame, 0 when the frame has none
+    */
+    Dictionary::Preset dictionary_;
+    uint64_t dictionary_size_;
+
+    //! Block checksums
+    /*
+     * Checksums of the blocks decoded,
+     * combined into the frame checksum
+    */
+    std::vector<uint64_t> block_checksums_;
+
+    //! Read Bit
+    /*
+     * Reads the next bit from the input,
+     * refilling the input_buffer_ when empty
+    */
+    bool ReadBit();
+
+    //! Read Bits
+    /*
+     * Reads an up to 64 bits big endian value
+    */
+    uint64_t ReadBits(int n_bits);
+
+    //! Decode Table
+    /*
+     * Reads a Huffman header with symbols of
+     * n_symbol_bits bits to code_to_symbol
+    */
+    void DecodeTable(int n_symbol_bits,
+                     std::map<std::pair<int, uint64_t>, int> &code_to_symbol);
+
+    //! Decode Symbol
+    /*
+     * Reads bits until they form a code of code_to_symbol
+     * and returns its symbol
+    */
+    int DecodeSymbol(const std::map<std::pair<int, uint64_t>, int> &code_to_symbol);
+
+    //! Slide Window
+    /*
+     * Flushes the pending bytes to output and moves the
+     * last kMaxOffset bytes to the window_ beginning
+    */
+    void SlideWindow(std::ostream &output);
+
+    //! Flush Window
+    /*
+     * Writes the window_ bytes not flushed yet,
+     * clipped to the output range
+    */
+    void FlushWindow(std::ostream &output);
+
+    //! Initialize
+    /*
+     * Resets the decoder to read input from its current
+     * position, the raw_offset original content position
+    */
+    void Initialize(std::istream &input, uint64_t raw_offset);
+
+    //! Hash Window
+    /*
+     * Consumes the decoded bytes not hashed
+     * yet into the block checksum
+    */
+    void HashWindow();
+
+    //! Decompress Blocks function
+    /*
+     * Decodes blocks until the end mark or until raw_end
+     * is decoded. Returns the restart blocks decoded.
+    */
+    uint64_t DecompressBlocks(uint64_t raw_end, std::ostream &output);
+
+    //! Read Bytes function
+    /*
+     * Reads n byte aligned bytes to bytes
+    */
+    void ReadBytes(uint8_t *bytes, size_t n);
+
+    //! Decompress Block function
+    /*
+     * Decodes a block payload of raw_size bytes, whose
+     * matches may reference the previous blocks
+    */
+    void DecompressBlock(uint64_t raw_size, uint8_t flags, std::ostream &output);
+
+    //! Use Dictionary function
+    /*
+     * Checks that the dictionary set is the one the frame
+     * names, if it names one. Throws std::invalid_argument
+     * otherwise.
+    */
+    void UseDictionary(const Frame::FrameHeader &frame_header);
+
+    //! Preload Dictionary function
+    /*
+     * Flushes the window_ and puts the dictionary bytes
+     * before the restart block about to be decoded
+    */
+    void PreloadDictionary(std::ostream &output);
+
+  public:
+    //! Window flush size
+    /*
+     * Bytes decoded after the kept kMaxOffset bytes
+     * before they are flushed to the output
+    */
+    static const size_t kFlushSize = 1 << 16;
+
+    //! Set Dictionary function
+    /*
+     * Sets the preset dictionary of the frames
+     * whose header names its identifier
+    */
+    void SetDictionary(const Dictionary::Preset &dictionary);
+
+    //! Decompress Stream function
+    /*
+     * Decompresses the frame read from input, as written
+     * by the StreamEncoder, and writes the original
+     * content to output
+    */
+    void DecompressStream(std::istream &input, std::ostream &output);
+
+    //! Decompress Range function
+    /*
+     * Writes length bytes of the original content, starting
+     * at offset, to output. The seekable input frame must have
+     * a block index, only the blocks from the restart point
+     * before offset up to offset + length are decoded.
+    */
+    void DecompressRange(std::istream &input, uint64_t offset,
+                         uint64_t length, std::ostream &output);
+
+    //! Read Index function
+    /*
+     * Reads the block index at the end of a seekable
+     * input frame, whose header is stored in frame_header
+    */
+    static std::vector<Frame::IndexEntry> ReadIndex(std::istream &input,
+                                                    Frame::FrameHeader &frame_header);
+
+    //! Verify Segment function
+    /*
+     * Decodes the blocks from the restart point up to raw_end,
+     * discarding their content, and checks their checksums.
+     * Returns the checksums, in the frame checksum order.
+    */
+    std::vector<uint64_t> VerifySegment(std::istream &input,
+                                        const Frame::FrameHeader &frame_header,
+                                        const Frame::IndexEntry &restart,
+                                        uint64_t raw_end);
+  };
+
+  //! Stream Encoder class
+  /*
+    * Stream Encoder
+    *
+    * Compresses a content pushed in chunks, block by block,
+    * to a .lz77 frame (see frame.h). Only the current block
+    * and the last kMaxOffset bytes of the previous ones are
+    * kept in memory. Matches may reference previous blocks.
+    */
+  class StreamEncoder
+  {
+  private:
+    //! Block size
+    /*
+     * Bytes compressed in each block
+    */
+    size_t block_size_;
+
+    //! History
+    /*
+     * Last bytes of the previous blocks,
+     * referenced by the current block matches
+    */
+    std::string history_;
+
+    //! Block
+    /*
+     * Bytes pushed and not compressed yet
+    */
+    std::string block_;
+
+    //! Bytes of history_ and block_
+    Allocator::Account buffers_account_{Allocator::kWindow};
+
+    //! Block index
+    /*
+     * Whether the block index is written at the
+     * frame end, and its entries so far
+    */
+    bool block_index_;
+    std::vector<Frame::IndexEntry> index_;
+
+    //! Frame positions
+    /*
+     * Raw bytes compressed, frame bytes
+     * output so far and frame header bytes
+    */
+    uint64_t raw_offset_;
+    uint64_t compressed_offset_;
+    uint64_t header_size_;
+
+    //! Restart interval
+    /*
+     * Raw bytes between restart points, 0 when only
+     * the first block is one, and the last one position
+    */
+    uint64_t restart_interval_;
+    uint64_t restart_raw_offset_;
+
+    //! Checksums
+    /*
+     * Whether the content checksums are written,
+     * and the blocks ones so far
+    */
+    bool checksum_;
+    std::vector<uint64_t> block_checksums_;
+
+    //! Preset dictionary
+    /*
+     * Dictionary put before every restart block
+    */
+    Dictionary::Preset dictionary_;
+
+    //! Previous tables
+    /*
+     * Huffman codes of the last block that sent them,
+     * reused while they cost less than new ones
+    */
+    bool has_tables_;
+    CodeTable offset_codes_;
+    CodeTable length_codes_;
+
+    //! Parsed Block
+    /*
+     * Block whose triples are found, waiting for its tables and
+     * bits, then holding its compressed bytes or the error
+     * they raised. A stop block ends the writer thread.
+    */
+    struct ParsedBlock
+    {
+      std::unique_ptr<Encoder> encoder;
+      size_t raw_size = 0;
+      uint8_t flags = 0;
+      bool stop = false;
+      std::vector<uint8_t> output;
+      std::exception_ptr error;
+    };
+
+    //! Parsed offset
+    /*
+     * Raw bytes parsed so far, ahead of raw_offset_
+     * by the blocks in the pipeline
+    */
+    uint64_t parsed_offset_;
+
+    //! Encoders
+    /*
+     * Encoders not holding a block, reset and
+     * reused by the next blocks
+    */
+    std::vector<std::unique_ptr<Encoder>> free_encoders_;
+
+    //! Pipeline
+    /*
+     * Whether a writer thread computes the tables and writes
+     * the bits of a block while the next one is parsed. The
+     * blocks go through the parsed_ queue to the writer and
+     * come back through written_, at most kPipelineDepth
+     * blocks at once.
+    */
+    static const size_t kPipelineDepth = 2;
+
+    bool pipeline_;
+    std::thread writer_;
+    std::unique_ptr<ThreadPool::SpscQueue<ParsedBlock>> parsed_;
+    std::unique_ptr<ThreadPool::SpscQueue<ParsedBlock>> written_;
+    size_t in_flight_;
+
+    //! Compress Block function
+    /*
+     * Compresses n bytes as a block and appends it to
+     * output, or hands it to the writer thread and
+     * appends the blocks it finished meanwhile
+    */
+    void CompressBlock(const char *source, size_t n,
+                       std::vector<uint8_t> &output);
+
+    //! Parse Block function
+    /*
+     * Finds the triples of n bytes, the parser stage
+    */
+    ParsedBlock ParseBlock(const char *source, size_t n);
+
+    //! Write Block function
+    /*
+     * Chooses the tables of a parsed block and appends
+     * its header and bits to output, the writer stage
+    */
+    void WriteBlock(ParsedBlock &block, std::vector<uint8_t> &output);
+
+    //! Collect Block function
+    /*
+     * Appends a block back from the writer to output
+     * and keeps its encoder, rethrowing its error
+    */
+    void CollectBlock(ParsedBlock &block, std::vector<uint8_t> &output);
+
+    //! Drain function
+    /*
+     * Collects the blocks in the pipeline to output,
+     * nullptr to drop them, and joins the writer
+    */
+    void Drain(std::vector<uint8_t> *output);
+
+    //! Writer Loop function
+    void WriterLoop();
+
+  public:
+    //! Default block size
+    static const size_t kBlockSize = 1 << 20;
+
+    StreamEncoder(size_t block_size = kBlockSize);
+    StreamEncoder(StreamEncoder &&other) = default;
+    StreamEncoder &operator=(StreamEncoder &&other) = default;
+
+    //! Joins the writer thread, dropping its blocks
+    ~StreamEncoder();
+
+    //! Set Pipeline
+    /*
+     * Parses each block while a writer thread entropy codes
+     * the previous one. Set before Begin, off by default.
+     * Update then returns the blocks written so far.
+    */
+    void SetPipeline(bool pipeline);
+
+    //! Set Block Index
+    /*
+     * Writes the block index at the frame end,
+     * set before Begin
+    */
+    void SetBlockIndex(bool block_index);
+
+    //! Set Restart Interval
+    /*
+     * Makes a restart point, a block referencing neither
+     * previous blocks content nor tables, every interval raw
+     * bytes. Set before Begin, 0 disables them.
+    */
+    void SetRestartInterval(uint64_t interval);
+
+    //! Set Dictionary
+    /*
+     * Puts the preset dictionary before every restart
+     * block, so its matches may reference it, and names
+     * it in the frame header. Set before Begin.
+    */
+    void SetDictionary(const Dictionary::Preset &dictionary);
+
+    //! Set Checksum
+    /*
+     * Writes the blocks and frame content
+     * checksums, set before Begin. On by default.
+    */
+    void SetChecksum(bool checksum);
+
+    //! Begin function
+    /*
+     * Starts a new stream, forgetting the
+     * previous one. Returns the frame header.
+    */
+    std::vector<uint8_t> Begin();
+
+    //! Update function
+    /*
+     * Pushes n bytes to the stream. Returns the compressed
+     * blocks completed by them, the pipelined ones later.
+    */
+    std::vector<uint8_t> Update(const void *chunk, size_t n);
+
+    //! End function
+    /*
+     * Compresses the bytes left and returns them
+     * with the end mark and the block index
+    */
+    std::vector<uint8_t> End();
+
+    //! Flush function
+    /*
+     * Compresses the bytes pushed so far, even less
+     * than a block, without ending the stream
+    */
+    std::vector<uint8_t> Flush();
+
+    //! Segment struct
+    /*
+     * What a flushed stream compressed apart adds to the frame
+     * it is appended to: its restart points and block checksums,
+     * and its sizes, the offsets counting from its first block
+    */
+    struct Segment
+    {
+      std::vector<Frame::IndexEntry> index;
+      std::vector<uint64_t> block_checksums;
+      uint64_t raw_size = 0;
+      uint64_t compressed_size = 0;
+      uint64_t restart_raw_offset = 0;
+    };
+
+    //! Take Segment function
+    /*
+     * Returns the blocks of this flushed stream as a segment,
+     * the stream may then Begin the next one
+    */
+    Segment TakeSegment();
+
+    //! Append Segment function
+    /*
+     * Accounts for the blocks of segment, a stream of the same
+     * block size compressed apart and flushed, as written by this
+     * flushed stream. The caller writes the segment blocks, without
+     * their frame header, right after this stream output so far.
+     * Later blocks do not reference the segment content.
+    */
+    void AppendSegment(const Segment &segment);
+
+    //! Trim function
+    /*
+     * Frees the encoders kept for the next blocks,
+     * for a stream not compressing for a while
+    */
+    void Trim();
   };
 
+  //! Encoder Context class
+  /*
+    * Encoder Context
+    *
+    * Compresses independent contents one after the other, as
+    * Compress does, for services handling many small messages.
+    * The encoder arena, its content and triples buffers and
+    * the output bitstream are kept between contents, so once
+    * they fit the largest one no more memory is taken.
+    */
+  class EncoderContext
+  {
+  private:
+    Encoder encoder_;
+    std::unique_ptr<Bitstream> bstream_;
+
+  public:
+    EncoderContext();
+    ~EncoderContext();
+
+    //! Compress function
+    /*
+     * Compresses n bytes from source to destination as
+     * LZ77::Compress. Returns the compressed size, or 0
+     * if it does not fit in the capacity.
+    */
+    size_t Compress(const void *source, size_t n,
+                    void *destination, size_t capacity);
+
+    //! Reset function
+    /*
+     * Forgets the last content, keeping the buffers.
+     * Compress calls it first.
+    */
+    void Reset();
+
+    //! Set Dictionary
+    /*
+     * Compresses the next contents with a preset dictionary,
+     * seeded once for all of them. Their decoder needs it.
+    */
+    void SetDictionary(const Dictionary::Preset &dictionary);
+  };
+
+  //! Decoder Context class
+  /*
+    * Decoder Context
+    *
+    * Decompresses independent contents one after the other,
+    * as Decompress does, keeping the decoder bit and output
+    * buffers between them
+    */
+  class DecoderContext
+  {
+  private:
+    Decoder decoder_;
+
+  public:
+    //! Decompress function
+    /*
+     * Decompresses n bytes from source to destination as
+     * LZ77::Decompress, which returns and throws the same
+    */
+    size_t Decompress(const void *source, size_t n,
+                      void *destination, size_t capacity);
+
+    //! Reset function
+    /*
+     * Forgets the last content, keeping the buffers.
+     * Decompress calls it first.
+    */
+    void Reset();
+
+    //! Set Dictionary
+    /*
+     * Decompresses the contents compressed with a preset
+     * dictionary, the others are decompressed as before
+    */
+    void SetDictionary(const Dictionary::Preset &dictionary);
+  };
+
+  //! Decompress Range function
+  /*
+     * Writes length bytes of the original content of
+     * a .lz77 file, starting at offset, to output. The
+     * file must have been written with a block index, and
+     * with dictionary if its header names one.
+    */
+  void DecompressRange(std::string file_path, uint64_t offset,
+                       uint64_t length, std::ostream &output,
+                       const Dictionary::Preset &dictionary = Dictionary::Preset());
+
+  //! Test File function
+  /*
+     * Decodes a .lz77 file without writing its content and
+     * checks its checksums. With a block index the segments
+     * between restart points are verified by n_threads
+     * threads. Throws std::invalid_argument when corrupted,
+     * or when its header names another dictionary.
+    */
+  void TestFile(std::string file_path, unsigned n_threads,
+                const Dictionary::Preset &dictionary = Dictionary::Preset());
+
   //! 4B Integer To Binary String function
   /*
      * Receives a integer and converts it
@@ -342,6 +1443,53 @@ namespace LZ77
      * to an integer
     */
   int BinStringToInt(std::string bin_value);
+
+  //! Copy Match function
+  /*
+     * Copies length bytes found offset bytes before
+     * destination to destination. The match may overlap
+     * itself when offset < length. Up to kWildCopySlack
+     * bytes after the match may be overwritten. The
+     * offset of a match is never 0.
+    */
+  void CopyMatch(uint8_t *destination, size_t offset, size_t length);
+
+  //! Compress Bound function
+  /*
+     * Largest compressed size Compress can produce
+     * for a source of n bytes
+    */
+  size_t CompressBound(size_t n);
+
+  //! Compress function
+  /*
+     * Compresses n bytes from source to destination, with the
+     * same content as a .lz77 file. Returns the compressed size,
+     * or 0 if it does not fit in the capacity. An EncoderContext
+     * reuses its buffers over many calls.
+    */
+  size_t Compress(const void *source, size_t n,
+                  void *destination, size_t capacity);
+
+  //! Decompressed Size function
+  /*
+     * Original size of the n bytes of a .lz77 content read
+     * from its header, the capacity Decompress needs.
+     * Throws std::invalid_argument if it is truncated.
+    */
+  uint64_t DecompressedSize(const void *source, size_t n);
+
+  //! Decompress function
+  /*
+     * Decompresses n bytes of a .lz77 content from source
+     * to destination. Returns the decompressed size, 0 for
+     * an empty content. Throws std::length_error if it does
+     * not fit in the capacity, and std::invalid_argument if
+     * it is corrupted or needs a dictionary the decoder has
+     * not. A DecoderContext reuses its buffers over many calls.
+    */
+  size_t Decompress(const void *source, size_t n,
+                    void *destination, size_t capacity);
 } // namespace LZ77
 
 #endif
\ No newline at end of file
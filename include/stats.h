@@ -0,0 +1,171 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <ostream>
+
+// Counters are compiled in with -DLZ77_STATS=1,
+// otherwise every counter update is dead code
+#ifndef LZ77_STATS
+#define LZ77_STATS 0
+#endif
+
+namespace Stats
+{
+  //! Enabled flag
+  /*
+   * Hot paths test it before touching the
+   * counters, so builds without them pay nothing
+  */
+  const bool kEnabled = LZ77_STATS;
+
+  //! Stages
+  /*
+   * Times are exclusive, a stage nested in
+   * another one is not counted twice
+  */
+  enum Stage
+  {
+    kParse,
+    kTables,
+    kWrite,
+    kChecksum,
+    kDecode,
+    kOutput,
+    kStageCount
+  };
+
+  //! Match length buckets, one per length
+  const int kLengthBuckets = 256;
+
+  //! Offset buckets
+  /*
+   * Bucket 0 holds the triples without match,
+   * bucket b the offsets in [2^(b-1), 2^b)
+  */
+  const int kOffsetBuckets = 17;
+
+  //! Counters
+  /*
+   * Every thread updates its own counters
+   * without synchronization
+  */
+  struct Counters
+  {
+    // Encoder
+    uint64_t encoded_blocks = 0;
+    uint64_t reused_tables = 0;
+    uint64_t encoded_bytes = 0;
+    uint64_t positions = 0;
+    uint64_t probes = 0;
+    uint64_t depth_total = 0;
+    uint64_t depth_max = 0;
+    uint64_t literal_triples = 0;
+    uint64_t matched_bytes = 0;
+    uint64_t length_histogram[kLengthBuckets] = {};
+    uint64_t offset_histogram[kOffsetBuckets] = {};
+
+    // Bits per stream
+    uint64_t header_bits = 0;
+    uint64_t offset_bits = 0;
+    uint64_t length_bits = 0;
+    uint64_t literal_bits = 0;
+
+    // Entropy bound of the offset and length streams
+    double offset_entropy_bits = 0;
+    double length_entropy_bits = 0;
+
+    // Decoder
+    uint64_t decoded_blocks = 0;
+    uint64_t decoded_bytes = 0;
+    uint64_t decoded_triples = 0;
+    uint64_t copied_bytes = 0;
+
+    uint64_t stage_ns[kStageCount] = {};
+
+    //! Running stage and since when, for the timers
+    int stage = -1;
+    uint64_t stage_begin = 0;
+
+    //! Merge function
+    /*
+     * Adds other counters to these
+    */
+    void Merge(const Counters &other);
+  };
+
+  //! Local function
+  /*
+   * Counters of the calling thread
+  */
+  Counters &Local();
+
+  //! Collect function
+  /*
+   * Sum of the counters of every thread, the
+   * threads still running must be idle
+  */
+  Counters Collect();
+
+  //! Record Triple function
+  /*
+   * Counts a triple in the histograms
+  */
+  void RecordTriple(Counters &counters, int offset, int length);
+
+  //! Write Json function
+  /*
+   * Writes the collected counters as a JSON object
+  */
+  void WriteJson(std::ostream &output);
+
+  //! Enter Stage function
+  /*
+   * Charges the time elapsed to the running stage and
+   * starts stage. Returns the stage interrupted.
+  */
+  int EnterStage(int stage);
+
+  //! Scoped Timer class
+  /*
+   * Charges the time until its destruction to
+   * a stage, pausing the stage it interrupts
+  */
+  class ScopedTimer
+  {
+  private:
+    int previous_;
+
+  public:
+    ScopedTimer(Stage stage) : previous_(-1)
+    {
+      if (kEnabled)
+      {
+        this->previous_ = EnterStage(stage);
+      }
+    }
+
+    ~ScopedTimer()
+    {
+      if (kEnabled)
+      {
+        EnterStage(this->previous_);
+      }
+    }
+
+    //! Switch function
+    /*
+     * Charges the time from now on to another stage
+    */
+    void Switch(Stage stage)
+    {
+      if (kEnabled)
+      {
+        EnterStage(stage);
+      }
+    }
+  };
+} // namespace Stats
+
+#endif
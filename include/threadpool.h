@@ -0,0 +1,323 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ThreadPool
+{
+  //! Task
+  /*
+   * Unit of work run by a single worker
+  */
+  typedef std::function<void()> Task;
+
+  //! Work Stealing Pool class
+  /*
+    * Thread Pool
+    *
+    * Every worker owns a deque of tasks. Tasks submitted
+    * by a worker go to its own deque, the others are dealt
+    * round robin. A worker runs its newest task first and,
+    * once its deque is empty, steals the oldest task of
+    * another worker, so large files split in several tasks
+    * keep every worker busy.
+    */
+  class WorkStealingPool
+  {
+  private:
+    //! Worker queue
+    /*
+     * Tasks of a worker and the lock
+     * guarding them against thieves
+    */
+    struct WorkerQueue
+    {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    //! Pending tasks
+    /*
+     * Tasks submitted and not finished yet, the
+     * workers sleep while none is queued
+    */
+    std::atomic<uint64_t> pending_;
+    std::atomic<uint64_t> queued_;
+    std::mutex sleep_mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable all_done_;
+
+    //! Next queue for tasks submitted outside the workers
+    std::atomic<size_t> next_queue_;
+
+    bool stop_;
+
+    //! Pop Task function
+    /*
+     * Takes a task from the worker own deque or
+     * steals one. Returns false when none is queued.
+    */
+    bool PopTask(size_t worker, Task &task);
+
+    //! Worker Loop function
+    void WorkerLoop(size_t worker);
+
+  public:
+    //! Creates n_workers threads, at least one
+    WorkStealingPool(size_t n_workers);
+
+    //! Waits for the queued tasks and joins the workers
+    ~WorkStealingPool();
+
+    //! Submit function
+    /*
+     * Queues a task, it may be called from a task.
+     * Tasks must not throw.
+    */
+    void Submit(Task task);
+
+    //! Wait function
+    /*
+     * Blocks until every submitted task finished,
+     * it must not be called from a task
+    */
+    void Wait();
+
+    //! Workers number
+    size_t Size() const;
+
+    //! Worker Index function
+    /*
+     * Index of the calling worker in its pool,
+     * to reach per worker state, or -1 outside
+     * the workers
+    */
+    static int WorkerIndex();
+  };
+
+  //! SPSC Queue class
+  /*
+    * Single Producer Single Consumer Queue
+    *
+    * Bounded ring between two threads, one pushing and one
+    * popping. The slots are published through the head and
+    * tail counters without a lock, a side finding the ring
+    * full or empty sleeps until the other one moves, which
+    * bounds the items in flight.
+    */
+  template <typename T>
+  class SpscQueue
+  {
+  private:
+    std::vector<T> slots_;
+
+    //! Next slot to pop and next slot to push, apart
+    //! so each side writes its own cache line
+    alignas(64) std::atomic<uint64_t> head_;
+    alignas(64) std::atomic<uint64_t> tail_;
+
+    //! Sides sleeping, woken on the other side moves
+    std::atomic<int> sleepers_;
+    std::mutex mutex_;
+    std::condition_variable moved_;
+
+    //! Sleeps until ready returns true
+    template <typename Ready>
+    void WaitUntil(Ready ready)
+    {
+      if (ready())
+      {
+        return;
+      }
+
+      std::unique_lock<std::mutex> lock(this->mutex_);
+
+      // Counted before checking again, so a move
+      // published after the check wakes this side
+      this->sleepers_++;
+      this->moved_.wait(lock, ready);
+      this->sleepers_--;
+    }
+
+    //! Wakes the other side if it sleeps
+    void Wake()
+    {
+      if (this->sleepers_ > 0)
+      {
+        // The sleeper holds the lock until it waits
+        {
+          std::lock_guard<std::mutex> lock(this->mutex_);
+        }
+
+        this->moved_.notify_all();
+      }
+    }
+
+  public:
+    SpscQueue(size_t capacity)
+        : slots_(std::max<size_t>(capacity, 1)),
+          head_(0),
+          tail_(0),
+          sleepers_(0)
+    {
+    }
+
+    //! Push function
+    /*
+     * Appends an item, waiting while the ring is full.
+     * Called by the producer only.
+    */
+    void Push(T item)
+    {
+      uint64_t tail = this->tail_.load(std::memory_order_relaxed);
+
+      this->WaitUntil([&]()
+                      { return tail - this->head_ < this->slots_.size(); });
+
+      this->slots_[tail % this->slots_.size()] = std::move(item);
+      this->tail_ = tail + 1;
+      this->Wake();
+    }
+
+    //! Pop function
+    /*
+     * Removes the oldest item, waiting while the ring
+     * is empty. Called by the consumer only.
+    */
+    T Pop()
+    {
+      uint64_t head = this->head_.load(std::memory_order_relaxed);
+
+      this->WaitUntil([&]()
+                      { return this->tail_ != head; });
+
+      T item = std::move(this->slots_[head % this->slots_.size()]);
+
+      this->head_ = head + 1;
+      this->Wake();
+
+      return item;
+    }
+
+    //! Try Pop function
+    /*
+     * Removes the oldest item into item without
+     * waiting. Returns false when the ring is empty.
+    */
+    bool TryPop(T &item)
+    {
+      uint64_t head = this->head_.load(std::memory_order_relaxed);
+
+      if (this->tail_ == head)
+      {
+        return false;
+      }
+
+      item = std::move(this->slots_[head % this->slots_.size()]);
+      this->head_ = head + 1;
+      this->Wake();
+
+      return true;
+    }
+  };
+
+  //! Reorder Buffer class
+  /*
+    * Reorder Buffer
+    *
+    * Ring of capacity slots where items finished out of order
+    * by several threads are handed back in sequence. The thread
+    * putting an item takes the writer turn if it is free and
+    * writes every consecutive ready item, so the oldest one is
+    * written as soon as it is done and nobody waits for the
+    * writer. An item may only be put once its sequence is less
+    * than the next one to write plus the capacity, callers
+    * bound the items in flight to keep it so.
+    */
+  template <typename T>
+  class ReorderBuffer
+  {
+  private:
+    struct Slot
+    {
+      std::atomic<bool> ready{false};
+      T item;
+    };
+
+    size_t capacity_;
+    std::unique_ptr<Slot[]> slots_;
+
+    //! Next sequence to write, moved by the writer only
+    std::atomic<uint64_t> next_;
+
+    //! Writer turn, held while writing
+    std::atomic<bool> writing_;
+
+  public:
+    ReorderBuffer(size_t capacity)
+        : capacity_(std::max<size_t>(capacity, 1)),
+          slots_(new Slot[capacity_]),
+          next_(0),
+          writing_(false)
+    {
+    }
+
+    //! Capacity
+    size_t Capacity() const
+    {
+      return this->capacity_;
+    }
+
+    //! Put function
+    /*
+     * Stores the item of a sequence, then writes the ready
+     * items in order with write(sequence, item) if no other
+     * thread is writing them
+    */
+    template <typename Write>
+    void Put(uint64_t sequence, T item, Write write)
+    {
+      Slot &slot = this->slots_[sequence % this->capacity_];
+
+      slot.item = std::move(item);
+      slot.ready = true;
+
+      // A writer leaving checks the next slot again, so an
+      // item put while it held the turn is not forgotten
+      while (!this->writing_.exchange(true))
+      {
+        uint64_t next = this->next_;
+
+        while (this->slots_[next % this->capacity_].ready)
+        {
+          Slot &next_slot = this->slots_[next % this->capacity_];
+          T next_item = std::move(next_slot.item);
+
+          next_slot.ready = false;
+          this->next_ = ++next;
+          write(next - 1, next_item);
+        }
+
+        this->writing_ = false;
+
+        if (!this->slots_[next % this->capacity_].ready)
+        {
+          break;
+        }
+      }
+    }
+  };
+} // namespace ThreadPool
+
+#endif
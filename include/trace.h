@@ -0,0 +1,89 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <string>
+
+namespace Trace
+{
+  //! Event
+  /*
+   * Span of a thread, in nanoseconds since the trace
+   * start, with up to two numeric arguments
+  */
+  struct Event
+  {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+    const char *arg_names[2];
+    uint64_t args[2];
+    std::string label;
+  };
+
+  //! Start function
+  /*
+   * Starts recording spans, they
+   * are dropped until it is called
+  */
+  void Start();
+
+  //! Enabled function
+  bool Enabled();
+
+  //! Set Thread Name function
+  /*
+   * Names the calling thread in the timeline
+  */
+  void SetThreadName(const std::string &name);
+
+  //! Write function
+  /*
+   * Writes the spans of every thread in the Chrome Trace
+   * Event format, readable by chrome://tracing and Perfetto.
+   * The threads still running must be idle. Returns false
+   * if the file could not be written.
+  */
+  bool Write(const std::string &file_path);
+
+  //! Span class
+  /*
+   * Records the time from its construction to its
+   * destruction in the calling thread buffer, which
+   * no other thread writes, so workers do not wait
+   * on each other to trace
+  */
+  class Span
+  {
+  private:
+    Event event_;
+    bool enabled_;
+
+    //! Records the event, if any, in the thread buffer
+    void Close();
+
+  public:
+    Span(const char *name);
+    ~Span();
+
+    //! Arg function
+    /*
+     * Sets a numeric argument shown with the span
+    */
+    void Arg(const char *name, uint64_t value);
+
+    //! Label function
+    /*
+     * Sets a text argument shown with the span
+    */
+    void Label(const std::string &label);
+
+    //! Switch function
+    /*
+     * Ends the span and starts another one, without arguments
+    */
+    void Switch(const char *name);
+  };
+} // namespace Trace
+
+#endif
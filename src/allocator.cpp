@@ -0,0 +1,205 @@
+#include "../include/allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <cstdlib>
+#include <stdexcept>
+
+const char *const Allocator::kSubsystemNames[kSubsystemCount] = {
+    "window", "match_finder", "tokens", "entropy_tables", "io_buffers"};
+
+static void *MallocAllocate(size_t n, void *)
+{
+  return std::malloc(n);
+}
+
+static void MallocDeallocate(void *pointer, size_t, void *)
+{
+  std::free(pointer);
+}
+
+static Allocator::Hooks hooks = {MallocAllocate, MallocDeallocate, nullptr};
+
+static std::atomic<uint64_t> current[Allocator::kSubsystemCount];
+static std::atomic<uint64_t> peak[Allocator::kSubsystemCount];
+static std::atomic<uint64_t> total_current(0);
+static std::atomic<uint64_t> total_peak(0);
+static std::atomic<uint64_t> budget(0);
+
+static void RaisePeak(std::atomic<uint64_t> &peak_bytes, uint64_t bytes)
+{
+  uint64_t previous = peak_bytes.load(std::memory_order_relaxed);
+
+  while (bytes > previous &&
+         !peak_bytes.compare_exchange_weak(previous, bytes,
+                                           std::memory_order_relaxed))
+  {
+  }
+}
+
+void Allocator::SetHooks(const Hooks &new_hooks)
+{
+  hooks = new_hooks;
+}
+
+void Allocator::SetBudget(uint64_t new_budget)
+{
+  budget = new_budget;
+}
+
+Allocator::Usage Allocator::GetUsage()
+{
+  Usage usage;
+
+  for (int i = 0; i < kSubsystemCount; i++)
+  {
+    usage.current[i] = current[i];
+    usage.peak[i] = peak[i];
+  }
+
+  usage.total_current = total_current;
+  usage.total_peak = total_peak;
+  usage.budget = budget;
+
+  return usage;
+}
+
+void Allocator::Charge(Subsystem subsystem, uint64_t n)
+{
+  uint64_t total = total_current.fetch_add(n, std::memory_order_relaxed) + n;
+  uint64_t limit = budget.load(std::memory_order_relaxed);
+
+  // Nothing is charged when the budget refuses it
+  if (limit > 0 && total > limit)
+  {
+    total_current.fetch_sub(n, std::memory_order_relaxed);
+    throw std::invalid_argument("Memory budget exceeded");
+  }
+
+  RaisePeak(total_peak, total);
+  RaisePeak(peak[subsystem],
+            current[subsystem].fetch_add(n, std::memory_order_relaxed) + n);
+}
+
+void Allocator::Release(Subsystem subsystem, uint64_t n)
+{
+  current[subsystem].fetch_sub(n, std::memory_order_relaxed);
+  total_current.fetch_sub(n, std::memory_order_relaxed);
+}
+
+void *Allocator::Allocate(Subsystem subsystem, size_t n)
+{
+  Charge(subsystem, n);
+
+  void *pointer = hooks.allocate(n, hooks.context);
+
+  if (pointer == nullptr)
+  {
+    Release(subsystem, n);
+    throw std::bad_alloc();
+  }
+
+  return pointer;
+}
+
+void Allocator::Deallocate(Subsystem subsystem, void *pointer, size_t n)
+{
+  hooks.deallocate(pointer, n, hooks.context);
+  Release(subsystem, n);
+}
+
+Allocator::Account::Account(Subsystem subsystem)
+    : subsystem_(subsystem),
+      bytes_(0)
+{
+}
+
+Allocator::Account::Account(const Account &other)
+    : subsystem_(other.subsystem_),
+      bytes_(0)
+{
+  this->Set(other.bytes_);
+}
+
+Allocator::Account &Allocator::Account::operator=(const Account &other)
+{
+  Release(this->subsystem_, this->bytes_);
+  this->subsystem_ = other.subsystem_;
+  this->bytes_ = 0;
+  this->Set(other.bytes_);
+
+  return *this;
+}
+
+Allocator::Account::~Account()
+{
+  this->Set(0);
+}
+
+void Allocator::Account::Update(uint64_t bytes)
+{
+  if (bytes > this->bytes_)
+  {
+    Charge(this->subsystem_, bytes - this->bytes_);
+  }
+
+  else
+  {
+    Release(this->subsystem_, this->bytes_ - bytes);
+  }
+
+  this->bytes_ = bytes;
+}
+
+Allocator::Arena::Arena(Subsystem subsystem)
+    : subsystem_(subsystem),
+      capacity_(0),
+      chunk_(0),
+      used_(0)
+{
+  std::fill(std::begin(this->free_), std::end(this->free_), nullptr);
+}
+
+Allocator::Arena::~Arena()
+{
+  for (const auto &chunk : this->chunks_)
+  {
+    Allocator::Deallocate(this->subsystem_, chunk.first, chunk.second);
+  }
+}
+
+void *Allocator::Arena::Carve(size_t n)
+{
+  // The end of a full chunk is left unused
+  if (this->chunk_ < this->chunks_.size() &&
+      this->used_ + n > this->chunks_[this->chunk_].second)
+  {
+    this->chunk_++;
+    this->used_ = 0;
+  }
+
+  // Chunks double up to kMaxChunk bytes, so
+  // small inputs keep a small arena
+  if (this->chunk_ == this->chunks_.size())
+  {
+    size_t size = std::min(kMaxChunk, std::max(kMinChunk, this->capacity_));
+
+    this->chunks_.emplace_back(
+        static_cast<char *>(Allocator::Allocate(this->subsystem_, size)), size);
+    this->capacity_ += size;
+  }
+
+  void *block = this->chunks_[this->chunk_].first + this->used_;
+
+  this->used_ += n;
+
+  return block;
+}
+
+void Allocator::Arena::Reset()
+{
+  std::fill(std::begin(this->free_), std::end(this->free_), nullptr);
+  this->chunk_ = 0;
+  this->used_ = 0;
+}
@@ -0,0 +1,419 @@
+#include "../include/asyncio.h"
+#include "../include/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#if LZ77_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+static std::atomic<AsyncIO::Backend> preferred_backend(AsyncIO::kUring);
+
+AsyncIO::Queue::~Queue()
+{
+}
+
+void AsyncIO::SetBackend(Backend backend)
+{
+  preferred_backend = backend;
+}
+
+// Reads or writes as the request asks, retrying interruptions
+static int64_t Transfer(AsyncIO::Operation operation, int fd,
+                        char *data, size_t n, int64_t offset)
+{
+  ssize_t count;
+
+  do
+  {
+    if (operation == AsyncIO::kRead)
+    {
+      count = offset < 0 ? read(fd, data, n) : pread(fd, data, n, offset);
+    }
+
+    else
+    {
+      count = offset < 0 ? write(fd, data, n) : pwrite(fd, data, n, offset);
+    }
+  } while (count < 0 && errno == EINTR);
+
+  return count < 0 ? -errno : count;
+}
+
+// Requests run one after the other by a thread
+class ThreadQueue : public AsyncIO::Queue
+{
+private:
+  struct Request
+  {
+    AsyncIO::Operation operation;
+    int fd;
+    char *data;
+    size_t n;
+    int64_t offset;
+    int64_t result;
+    bool done;
+  };
+
+  std::vector<Request> requests_;
+  std::deque<int> pending_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool stop_;
+  std::thread thread_;
+
+  void Loop()
+  {
+    Trace::SetThreadName("io");
+
+    std::unique_lock<std::mutex> lock(this->mutex_);
+
+    while (true)
+    {
+      this->changed_.wait(lock, [this]()
+                          { return this->stop_ || !this->pending_.empty(); });
+
+      if (this->pending_.empty())
+      {
+        return;
+      }
+
+      Request &request = this->requests_[this->pending_.front()];
+
+      this->pending_.pop_front();
+      lock.unlock();
+
+      int64_t result = Transfer(request.operation, request.fd, request.data,
+                                request.n, request.offset);
+
+      lock.lock();
+      request.result = result;
+      request.done = true;
+      this->changed_.notify_all();
+    }
+  }
+
+public:
+  ThreadQueue(int n_buffers)
+      : requests_(n_buffers),
+        stop_(false),
+        thread_(&ThreadQueue::Loop, this)
+  {
+  }
+
+  ~ThreadQueue()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      this->stop_ = true;
+    }
+
+    this->changed_.notify_all();
+    this->thread_.join();
+  }
+
+  void Submit(int buffer, AsyncIO::Operation operation, int fd,
+              char *data, size_t n, int64_t offset) override
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+
+      this->requests_[buffer] = {operation, fd, data, n, offset, 0, false};
+      this->pending_.push_back(buffer);
+    }
+
+    this->changed_.notify_all();
+  }
+
+  int64_t Wait(int buffer) override
+  {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    Request &request = this->requests_[buffer];
+
+    this->changed_.wait(lock, [&]()
+                        { return request.done; });
+    request.done = false;
+
+    return request.result;
+  }
+
+  AsyncIO::Backend GetBackend() const override
+  {
+    return AsyncIO::kThread;
+  }
+};
+
+#if LZ77_IO_URING
+// Requests submitted to an io_uring instance through its
+// system calls, reading and writing the registered buffers
+class UringQueue : public AsyncIO::Queue
+{
+private:
+  int ring_fd_;
+  bool fixed_buffers_;
+
+  // Submission and completion rings, shared with the kernel
+  void *sq_ring_;
+  void *cq_ring_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  io_uring_sqe *sqes_;
+  size_t sqes_size_;
+
+  unsigned *sq_tail_;
+  unsigned *sq_mask_;
+  unsigned *sq_array_;
+  unsigned *cq_head_;
+  unsigned *cq_tail_;
+  unsigned *cq_mask_;
+  io_uring_cqe *cqes_;
+
+  // Completions reaped, per buffer
+  std::vector<int64_t> results_;
+  std::vector<bool> done_;
+
+  static int Enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags)
+  {
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                   flags, nullptr, 0);
+  }
+
+public:
+  UringQueue()
+      : ring_fd_(-1),
+        fixed_buffers_(false),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(static_cast<io_uring_sqe *>(MAP_FAILED))
+  {
+  }
+
+  ~UringQueue()
+  {
+    if (this->sqes_ != MAP_FAILED)
+    {
+      munmap(this->sqes_, this->sqes_size_);
+    }
+
+    if (this->cq_ring_ != MAP_FAILED && this->cq_ring_ != this->sq_ring_)
+    {
+      munmap(this->cq_ring_, this->cq_ring_size_);
+    }
+
+    if (this->sq_ring_ != MAP_FAILED)
+    {
+      munmap(this->sq_ring_, this->sq_ring_size_);
+    }
+
+    if (this->ring_fd_ >= 0)
+    {
+      close(this->ring_fd_);
+    }
+  }
+
+  //! Sets the ring up, false when the kernel refuses it
+  bool Setup(char *const *buffers, int n_buffers, size_t size)
+  {
+    io_uring_params params;
+
+    std::memset(&params, 0, sizeof(params));
+    this->ring_fd_ = syscall(__NR_io_uring_setup, 2 * n_buffers, &params);
+
+    // Offset -1 reads and writes at the file position, as pipes need
+    if (this->ring_fd_ < 0 || !(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+      return false;
+    }
+
+    this->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      this->sq_ring_size_ = std::max(this->sq_ring_size_, this->cq_ring_size_);
+      this->cq_ring_size_ = this->sq_ring_size_;
+    }
+
+    this->sq_ring_ = mmap(nullptr, this->sq_ring_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, this->ring_fd_,
+                          IORING_OFF_SQ_RING);
+
+    if (this->sq_ring_ == MAP_FAILED)
+    {
+      return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      this->cq_ring_ = this->sq_ring_;
+    }
+
+    else
+    {
+      this->cq_ring_ = mmap(nullptr, this->cq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, this->ring_fd_,
+                            IORING_OFF_CQ_RING);
+
+      if (this->cq_ring_ == MAP_FAILED)
+      {
+        return false;
+      }
+    }
+
+    this->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    this->sqes_ = static_cast<io_uring_sqe *>(
+        mmap(nullptr, this->sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, this->ring_fd_, IORING_OFF_SQES));
+
+    if (this->sqes_ == MAP_FAILED)
+    {
+      return false;
+    }
+
+    char *sq = static_cast<char *>(this->sq_ring_);
+    char *cq = static_cast<char *>(this->cq_ring_);
+
+    this->sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    this->sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    this->sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    this->cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    this->cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    this->cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    this->cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    // Registered buffers are pinned once instead of at every
+    // request, they may be refused over the locked memory limit
+    std::vector<iovec> iovecs(n_buffers);
+
+    for (int i = 0; i < n_buffers; i++)
+    {
+      iovecs[i].iov_base = buffers[i];
+      iovecs[i].iov_len = size;
+    }
+
+    this->fixed_buffers_ =
+        syscall(__NR_io_uring_register, this->ring_fd_, IORING_REGISTER_BUFFERS,
+                iovecs.data(), n_buffers) == 0;
+
+    this->results_.assign(n_buffers, 0);
+    this->done_.assign(n_buffers, false);
+
+    return true;
+  }
+
+  void Submit(int buffer, AsyncIO::Operation operation, int fd,
+              char *data, size_t n, int64_t offset) override
+  {
+    unsigned tail = *this->sq_tail_;
+    unsigned index = tail & *this->sq_mask_;
+    io_uring_sqe &sqe = this->sqes_[index];
+
+    std::memset(&sqe, 0, sizeof(sqe));
+
+    if (this->fixed_buffers_)
+    {
+      sqe.opcode = operation == AsyncIO::kRead ? IORING_OP_READ_FIXED
+                                               : IORING_OP_WRITE_FIXED;
+      sqe.buf_index = buffer;
+    }
+
+    else
+    {
+      sqe.opcode = operation == AsyncIO::kRead ? IORING_OP_READ
+                                               : IORING_OP_WRITE;
+    }
+
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(data);
+    sqe.len = n;
+    sqe.off = offset;
+    sqe.user_data = buffer;
+
+    this->sq_array_[index] = index;
+    __atomic_store_n(this->sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    int submitted;
+
+    do
+    {
+      submitted = Enter(this->ring_fd_, 1, 0, 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    // A refused request is taken back and fails
+    if (submitted < 0)
+    {
+      __atomic_store_n(this->sq_tail_, tail, __ATOMIC_RELEASE);
+      this->results_[buffer] = -errno;
+      this->done_[buffer] = true;
+    }
+  }
+
+  int64_t Wait(int buffer) override
+  {
+    while (!this->done_[buffer])
+    {
+      unsigned head = *this->cq_head_;
+
+      if (head == __atomic_load_n(this->cq_tail_, __ATOMIC_ACQUIRE))
+      {
+        if (Enter(this->ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR)
+        {
+          return -errno;
+        }
+
+        continue;
+      }
+
+      const io_uring_cqe &cqe = this->cqes_[head & *this->cq_mask_];
+
+      this->results_[cqe.user_data] = cqe.res;
+      this->done_[cqe.user_data] = true;
+      __atomic_store_n(this->cq_head_, head + 1, __ATOMIC_RELEASE);
+    }
+
+    this->done_[buffer] = false;
+
+    return this->results_[buffer];
+  }
+
+  AsyncIO::Backend GetBackend() const override
+  {
+    return AsyncIO::kUring;
+  }
+};
+#endif
+
+std::unique_ptr<AsyncIO::Queue> AsyncIO::Open(char *const *buffers, int n_buffers,
+                                              size_t size)
+{
+#if LZ77_IO_URING
+  if (preferred_backend == kUring)
+  {
+    std::unique_ptr<UringQueue> queue(new UringQueue());
+
+    if (queue->Setup(buffers, n_buffers, size))
+    {
+      return queue;
+    }
+  }
+#else
+  (void)buffers;
+  (void)size;
+#endif
+
+  return std::unique_ptr<Queue>(new ThreadQueue(n_buffers));
+}
@@ -0,0 +1,252 @@
+#include "../include/benchmark.h"
+#include "../include/lz77.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+
+// Output stream buffer over a preallocated buffer, so
+// decompression times do not include its growth
+class FixedOutputBuf : public std::streambuf
+{
+public:
+  FixedOutputBuf(std::vector<char> &buffer)
+  {
+    this->setp(buffer.data(), buffer.data() + buffer.size());
+  }
+
+  size_t Size() const
+  {
+    return this->pptr() - this->pbase();
+  }
+};
+
+// Input stream buffer reading a string in place
+class FixedInputBuf : public std::streambuf
+{
+public:
+  FixedInputBuf(const std::string &content)
+  {
+    char *begin = const_cast<char *>(content.data());
+
+    this->setg(begin, begin, begin + content.size());
+  }
+};
+
+static double Median(std::vector<double> values)
+{
+  std::sort(values.begin(), values.end());
+
+  size_t middle = values.size() / 2;
+
+  if (values.size() % 2 == 0)
+  {
+    return (values[middle - 1] + values[middle]) / 2;
+  }
+
+  return values[middle];
+}
+
+static double MegabytesPerSecond(uint64_t n_bytes, double seconds)
+{
+  return seconds > 0 ? n_bytes / seconds / 1e6 : 0;
+}
+
+bool Benchmark::LoadCorpus(const std::vector<std::string> &paths,
+                           std::vector<std::pair<std::string, std::string>> &corpus)
+{
+  std::vector<std::string> files;
+  bool ok = true;
+
+  for (const auto &path : paths)
+  {
+    std::error_code error;
+
+    if (!std::filesystem::is_directory(path, error))
+    {
+      files.push_back(path);
+      continue;
+    }
+
+    std::vector<std::string> directory_files;
+
+    for (auto it = std::filesystem::recursive_directory_iterator(path, error);
+         it != std::filesystem::recursive_directory_iterator();
+         it.increment(error))
+    {
+      if (it->is_regular_file(error))
+      {
+        directory_files.push_back(it->path().string());
+      }
+    }
+
+    // Same order on every run
+    std::sort(directory_files.begin(), directory_files.end());
+    files.insert(files.end(), directory_files.begin(), directory_files.end());
+  }
+
+  for (const auto &file_name : files)
+  {
+    std::ifstream file(file_name, std::ios::in | std::ios::binary | std::ios::ate);
+
+    if (!file)
+    {
+      fprintf(stderr, "%s: File not found\n", file_name.c_str());
+      ok = false;
+      continue;
+    }
+
+    std::string content(file.tellg(), '\0');
+
+    file.seekg(0, std::ios::beg);
+    file.read(&content[0], content.size());
+
+    corpus.emplace_back(std::filesystem::path(file_name).filename().string(),
+                        std::move(content));
+  }
+
+  return ok;
+}
+
+Benchmark::Result Benchmark::Measure(const std::string &name,
+                                     const std::string &content,
+                                     size_t block_size,
+                                     const Settings &settings)
+{
+  Result result;
+  std::vector<double> compress_times;
+  std::vector<double> decompress_times;
+  std::string compressed;
+  std::vector<char> decompressed(content.size());
+
+  result.name = name;
+  result.block_size = block_size;
+  result.raw_size = content.size();
+  result.round_trip = true;
+
+  for (int run = 0; run < settings.warmup + settings.iterations; run++)
+  {
+    // Compression
+    auto begin = std::chrono::steady_clock::now();
+
+    try
+    {
+      LZ77::StreamEncoder lz77_encoder(block_size);
+      std::vector<uint8_t> frame = lz77_encoder.Begin();
+      std::vector<uint8_t> blocks = lz77_encoder.Update(content.data(), content.size());
+      std::vector<uint8_t> end = lz77_encoder.End();
+
+      compressed.assign(frame.begin(), frame.end());
+      compressed.append(blocks.begin(), blocks.end());
+      compressed.append(end.begin(), end.end());
+    }
+
+    // Over the memory budget
+    catch (const std::invalid_argument &error)
+    {
+      compressed.clear();
+      result.round_trip = false;
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+
+    // Decompression
+    FixedInputBuf input_buffer(compressed);
+    FixedOutputBuf output_buffer(decompressed);
+    std::istream input(&input_buffer);
+    std::ostream output(&output_buffer);
+    LZ77::StreamDecoder lz77_decoder;
+
+    try
+    {
+      lz77_decoder.DecompressStream(input, output);
+    }
+
+    catch (const std::invalid_argument &error)
+    {
+      result.round_trip = false;
+    }
+
+    auto finish = std::chrono::steady_clock::now();
+
+    if (run >= settings.warmup)
+    {
+      compress_times.push_back(std::chrono::duration<double>(middle - begin).count());
+      decompress_times.push_back(std::chrono::duration<double>(finish - middle).count());
+    }
+
+    result.round_trip = result.round_trip && output &&
+                        output_buffer.Size() == content.size() &&
+                        std::equal(content.begin(), content.end(), decompressed.begin());
+  }
+
+  result.compressed_size = compressed.size();
+  result.compress_seconds = Median(compress_times);
+  result.decompress_seconds = Median(decompress_times);
+
+  return result;
+}
+
+bool Benchmark::Run(const std::vector<std::string> &paths, const Settings &settings)
+{
+  std::vector<std::pair<std::string, std::string>> corpus;
+  std::vector<size_t> block_sizes = settings.block_sizes;
+  bool ok = Benchmark::LoadCorpus(paths, corpus);
+
+  if (block_sizes.empty())
+  {
+    block_sizes.push_back(size_t(LZ77::StreamEncoder::kBlockSize));
+  }
+
+  printf("%d warm-up and %d timed runs, median times\n",
+         settings.warmup, settings.iterations);
+
+  for (size_t block_size : block_sizes)
+  {
+    uint64_t raw_total = 0;
+    uint64_t compressed_total = 0;
+    double compress_total = 0;
+    double decompress_total = 0;
+
+    printf("block size %zu\n", block_size);
+
+    for (const auto &file : corpus)
+    {
+      Result result = Benchmark::Measure(file.first, file.second,
+                                         block_size, settings);
+
+      printf("%-20s :%10llu ->%10llu (%6.3f), %8.3f MB/s, %8.3f MB/s%s\n",
+             result.name.c_str(),
+             (unsigned long long)result.raw_size,
+             (unsigned long long)result.compressed_size,
+             (double)result.raw_size / result.compressed_size,
+             MegabytesPerSecond(result.raw_size, result.compress_seconds),
+             MegabytesPerSecond(result.raw_size, result.decompress_seconds),
+             result.round_trip ? "" : "  ROUND TRIP FAILED");
+      fflush(stdout);
+
+      ok = ok && result.round_trip;
+      raw_total += result.raw_size;
+      compressed_total += result.compressed_size;
+      compress_total += result.compress_seconds;
+      decompress_total += result.decompress_seconds;
+    }
+
+    if (!corpus.empty())
+    {
+      printf("%-20s :%10llu ->%10llu (%6.3f), %8.3f MB/s, %8.3f MB/s\n",
+             "total",
+             (unsigned long long)raw_total,
+             (unsigned long long)compressed_total,
+             (double)raw_total / compressed_total,
+             MegabytesPerSecond(raw_total, compress_total),
+             MegabytesPerSecond(raw_total, decompress_total));
+    }
+  }
+
+  return ok;
+}
@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <stdexcept>
 
 //----------------------------------------
 //Constructors
@@ -35,10 +37,10 @@ Bitstream::Bitstream(Bitstream& bs2, uint64_t nbits) :
 	
 	if (nbits <= bs2.numberOfRemainingBits())
 	{
-		data.reserve(nbits * 8);
+		data.reserve(nbits / 8 + 1);
 
 		bool bit;
-		for (int i = 0; i < nbits ; i++)
+		for (uint64_t i = 0; i < nbits ; i++)
 		{
 			bit = bs2.readBit();
 			this->writeBit(bit);
@@ -69,7 +71,7 @@ Bitstream::Bitstream(std::string filename) :
 {
 	
 	std::ifstream file;
-	unsigned int nbytes;
+	uint64_t nbytes;
 
 	//ios::in : read in input mode
 	//ios::binary : read in binary mode
@@ -79,7 +81,7 @@ Bitstream::Bitstream(std::string filename) :
 	if (file.is_open())
 	{
 		//Reads the number of bytes in the file.
-		nbytes = (unsigned int) file.tellg();
+		nbytes = static_cast<uint64_t>(file.tellg());
 
 		//std::cout << "Number of bytes = " << nbytes << std::endl;
 
@@ -106,7 +108,7 @@ Bitstream::Bitstream(std::string filename) :
 				//Reserves the number of bytes.
 				data.resize(nbytes - 1);
 				//Reads all bytes to the data vector.
-				file.read(reinterpret_cast<char*> (&data[0]), nbytes * sizeof(data[0]));
+				file.read(reinterpret_cast<char*> (&data[0]), (nbytes - 1) * sizeof(data[0]));
 
 				//int i = 0;
 				//for (auto& elem : data)
@@ -144,6 +146,48 @@ Bitstream::Bitstream(std::string filename) :
 	
 }
 
+//Creates a new bitstream from a memory buffer holding the same bytes as a file
+//written by flushesToFile (header byte followed by the data).
+//The bytes are copied, the buffer can be released after the constructor returns.
+//The bitstream created is returned in READ mode.
+//Throws std::invalid_argument if the buffer is empty or has no header byte.
+Bitstream::Bitstream(const uint8_t* buffer, uint64_t nbytes) :
+	data(),
+	num_buf8(0),
+	buf8(0),
+	bitstream_pointer(0),
+	mode(READ),
+	reading_status(NOT_STARTED),
+	reading_num_valid_bits_last_byte(0)
+{
+	if (nbytes == 0)
+	{
+		throw std::invalid_argument("The input buffer is empty");
+	}
+	//Tests the first nibble.
+	else if ((buffer[0] & 0xF0) == 0xE0)
+	{
+		//Only the header: an empty bitstream, nothing to read.
+		if (nbytes > 1)
+		{
+			reading_num_valid_bits_last_byte = buffer[0] & 0x0F;
+
+			//Copies all bytes after the header to the data vector.
+			data.assign(buffer + 1, buffer + nbytes);
+
+			//If all went well
+			buf8              = data[0];   //Gets the first byte.
+			num_buf8          = 8;         //Number of unread bits in this buffer.
+			bitstream_pointer = 1;         //points to the next byte to be read.
+			reading_status    = READING;   //status: reading!
+		}
+	}
+	else
+	{
+		throw std::invalid_argument("The input buffer is not conforming to the Bitstream");
+	}
+}
+
 //Destructors
 Bitstream::~Bitstream()
 {
@@ -152,6 +196,18 @@ Bitstream::~Bitstream()
 
 //----------------------------------------
 //Public Functions
+//Empties the bitstream to write it again, keeping its capacity.
+void Bitstream::reset()
+{
+	data.clear();
+	num_buf8 = 0;
+	buf8 = 0;
+	bitstream_pointer = 0;
+	reading_num_valid_bits_last_byte = 0;
+	mode = WRITE;
+	reading_status = NOT_STARTED;
+}
+
 void Bitstream::writeBit(bool bit)
 {
 	buf8 <<= 1;
@@ -309,6 +365,40 @@ void Bitstream::flushesToFile(std::string filename)
 	}
 }
 
+//Number of bytes flushesToFile and flushesToBuffer output:
+//the header byte, the packed data and the incomplete last byte, if any.
+uint64_t Bitstream::flushedSize()
+{
+	return 1 + data.size() + ((num_buf8 > 0) ? 1 : 0);
+}
+
+//Writes the same bytes as flushesToFile to a memory buffer.
+//Returns the number of bytes written, or 0 if they do not fit in the capacity.
+uint64_t Bitstream::flushesToBuffer(uint8_t* buffer, uint64_t capacity)
+{
+	uint64_t nbytes = flushedSize();
+
+	if (nbytes > capacity)
+	{
+		return 0;
+	}
+
+	//Computes and writes the first byte
+	uint8_t num_valid_bits_in_last_byte = ((num_buf8 == 0) ? 8 : num_buf8);
+	buffer[0] = uint8_t(0xE0) | uint8_t(num_valid_bits_in_last_byte);
+
+	//Writes the data that is already packed to 8 bits.
+	std::copy(data.begin(), data.end(), buffer + 1);
+
+	if (num_buf8 > 0)
+	{
+		//Computes and writes the last byte.
+		buffer[nbytes - 1] = uint8_t(buf8 << (8 - num_buf8));
+	}
+
+	return nbytes;
+}
+
 void Bitstream::flushesToDecompressedFile(std::string filename)
 {
 	std::ofstream file;
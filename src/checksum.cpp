@@ -0,0 +1,189 @@
+#include "../include/checksum.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+static const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t RotateLeft(uint64_t value, int n)
+{
+  return (value << n) | (value >> (64 - n));
+}
+
+// Little endian reads, as xxHash defines them
+static inline uint64_t Read64(const uint8_t *bytes)
+{
+  uint64_t value = 0;
+
+  for (int i = 7; i >= 0; i--)
+  {
+    value = (value << 8) | bytes[i];
+  }
+
+  return value;
+}
+
+static inline uint32_t Read32(const uint8_t *bytes)
+{
+  return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) |
+         ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static inline uint64_t Round(uint64_t lane, uint64_t input)
+{
+  lane += input * kPrime2;
+  lane = RotateLeft(lane, 31);
+
+  return lane * kPrime1;
+}
+
+static inline uint64_t MergeRound(uint64_t hash, uint64_t lane)
+{
+  hash ^= Round(0, lane);
+
+  return hash * kPrime1 + kPrime4;
+}
+
+// Consumes whole 32 bytes stripes, returns the bytes consumed
+static size_t ConsumeStripes(uint64_t lanes[4], const uint8_t *data, size_t n)
+{
+  const uint8_t *begin = data;
+
+  while (n >= 32)
+  {
+    lanes[0] = Round(lanes[0], Read64(data));
+    lanes[1] = Round(lanes[1], Read64(data + 8));
+    lanes[2] = Round(lanes[2], Read64(data + 16));
+    lanes[3] = Round(lanes[3], Read64(data + 24));
+    data += 32;
+    n -= 32;
+  }
+
+  return data - begin;
+}
+
+// Mixes the lanes, the bytes left and the size
+static uint64_t Finalize(const uint64_t lanes[4], uint64_t seed, uint64_t total_size,
+                         const uint8_t *data, size_t n)
+{
+  uint64_t hash;
+
+  if (total_size >= 32)
+  {
+    hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) +
+           RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+
+    for (int i = 0; i < 4; i++)
+    {
+      hash = MergeRound(hash, lanes[i]);
+    }
+  }
+
+  else
+  {
+    hash = seed + kPrime5;
+  }
+
+  hash += total_size;
+
+  while (n >= 8)
+  {
+    hash ^= Round(0, Read64(data));
+    hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+    data += 8;
+    n -= 8;
+  }
+
+  if (n >= 4)
+  {
+    hash ^= (uint64_t)Read32(data) * kPrime1;
+    hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+    data += 4;
+    n -= 4;
+  }
+
+  while (n > 0)
+  {
+    hash ^= (*data) * kPrime5;
+    hash = RotateLeft(hash, 11) * kPrime1;
+    data++;
+    n--;
+  }
+
+  // Avalanche
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+uint64_t Checksum::XXH64(const void *data, size_t n, uint64_t seed)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  uint64_t lanes[4] = {seed + kPrime1 + kPrime2, seed + kPrime2,
+                       seed, seed - kPrime1};
+
+  size_t consumed = ConsumeStripes(lanes, bytes, n);
+
+  return Finalize(lanes, seed, n, bytes + consumed, n - consumed);
+}
+
+Checksum::XXH64State::XXH64State(uint64_t seed)
+{
+  this->Reset(seed);
+}
+
+void Checksum::XXH64State::Reset(uint64_t seed)
+{
+  this->lanes_[0] = seed + kPrime1 + kPrime2;
+  this->lanes_[1] = seed + kPrime2;
+  this->lanes_[2] = seed;
+  this->lanes_[3] = seed - kPrime1;
+  this->seed_ = seed;
+  this->total_size_ = 0;
+  this->stripe_size_ = 0;
+}
+
+void Checksum::XXH64State::Update(const void *data, size_t n)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+  this->total_size_ += n;
+
+  // Completes the pending stripe first
+  if (this->stripe_size_ > 0)
+  {
+    size_t missing = std::min<size_t>(32 - this->stripe_size_, n);
+
+    std::memcpy(this->stripe_ + this->stripe_size_, bytes, missing);
+    this->stripe_size_ += missing;
+    bytes += missing;
+    n -= missing;
+
+    if (this->stripe_size_ < 32)
+    {
+      return;
+    }
+
+    ConsumeStripes(this->lanes_, this->stripe_, 32);
+    this->stripe_size_ = 0;
+  }
+
+  size_t consumed = ConsumeStripes(this->lanes_, bytes, n);
+
+  std::memcpy(this->stripe_, bytes + consumed, n - consumed);
+  this->stripe_size_ = n - consumed;
+}
+
+uint64_t Checksum::XXH64State::Digest() const
+{
+  return Finalize(this->lanes_, this->seed_, this->total_size_,
+                  this->stripe_, this->stripe_size_);
+}
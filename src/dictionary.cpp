@@ -0,0 +1,599 @@
+#include "../include/dictionary.h"
+#include "../include/checksum.h"
+#include "../include/frame.h"
+#include "../include/huffman.h"
+#include "../include/lz77.h"
+#include "../include/threadpool.h"
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+
+// Magic, version, identifier and content size
+static const size_t kHeaderSize = 13;
+
+// Bits of the d-mer frequency table index
+static const int kHashBits = 20;
+
+// Samples the dictionaries are measured on, one
+// in kTestInterval, and the most measured
+static const size_t kTestInterval = 10;
+static const size_t kMaxTestSamples = 100;
+
+// Samples compressed to build the default tables
+static const size_t kMaxTableSamples = 1000;
+
+// Appends a table as its symbols number and
+// (symbol, code size, code bytes) tuples
+static void SerializeTable(const std::map<std::string, std::string> &table,
+                           std::vector<uint8_t> &output)
+{
+  Frame::WriteUint(table.size(), 4, output);
+
+  for (const auto &p : table)
+  {
+    const std::string &code = p.second;
+
+    Frame::WriteUint(LZ77::BinStringToInt(p.first), 2, output);
+    Frame::WriteUint(code.size(), 1, output);
+
+    for (size_t base = 0; base < code.size(); base += 8)
+    {
+      uint8_t byte = 0;
+
+      for (size_t i = 0; i < 8; i++)
+      {
+        byte = (byte << 1) | (base + i < code.size() && code[base + i] == '1');
+      }
+
+      output.push_back(byte);
+    }
+  }
+}
+
+// Reads a table at position, moving it past the table
+static void ParseTable(const uint8_t *bytes, size_t n, size_t &position,
+                       std::map<std::string, std::string> &table)
+{
+  if (n - position < 4)
+  {
+    throw std::invalid_argument("Corrupted dictionary");
+  }
+
+  uint64_t n_symbols = Frame::ReadUint(bytes + position, 4);
+
+  position += 4;
+
+  for (uint64_t j = 0; j < n_symbols; j++)
+  {
+    if (n - position < 3)
+    {
+      throw std::invalid_argument("Corrupted dictionary");
+    }
+
+    int symbol = Frame::ReadUint(bytes + position, 2);
+    size_t code_size = bytes[position + 2];
+    size_t code_bytes = (code_size + 7) / 8;
+
+    position += 3;
+
+    if (code_size == 0 || n - position < code_bytes)
+    {
+      throw std::invalid_argument("Corrupted dictionary");
+    }
+
+    std::string code(code_size, '0');
+
+    for (size_t i = 0; i < code_size; i++)
+    {
+      if ((bytes[position + i / 8] >> (7 - i % 8)) & 1)
+      {
+        code[i] = '1';
+      }
+    }
+
+    position += code_bytes;
+    table[LZ77::IntToBinString(symbol, 16)] = code;
+  }
+}
+
+uint32_t Dictionary::ComputeId(const void *content, size_t n)
+{
+  uint32_t id = Checksum::XXH64(content, n);
+
+  return id != 0 ? id : 1;
+}
+
+Dictionary::Preset Dictionary::Create(const void *content, size_t n)
+{
+  Preset preset;
+  size_t size = std::min(n, kMaxSize);
+
+  preset.content.assign(static_cast<const char *>(content) + n - size, size);
+  preset.id = ComputeId(preset.content.data(), preset.content.size());
+
+  return preset;
+}
+
+void Dictionary::Serialize(const Preset &preset, std::vector<uint8_t> &output)
+{
+  Frame::WriteUint(kMagic, 4, output);
+  Frame::WriteUint(kVersion, 1, output);
+  Frame::WriteUint(preset.id, 4, output);
+  Frame::WriteUint(preset.content.size(), 4, output);
+  output.insert(output.end(), preset.content.begin(), preset.content.end());
+
+  if (!preset.offset_table.empty())
+  {
+    SerializeTable(preset.offset_table, output);
+    SerializeTable(preset.length_table, output);
+  }
+}
+
+Dictionary::Preset Dictionary::Parse(const uint8_t *bytes, size_t n)
+{
+  Preset preset;
+
+  if (n < kHeaderSize || Frame::ReadUint(bytes, 4) != kMagic)
+  {
+    throw std::invalid_argument("The input is not a dictionary");
+  }
+
+  if (bytes[4] != kVersion)
+  {
+    throw std::invalid_argument("Unsupported dictionary version");
+  }
+
+  uint64_t size = Frame::ReadUint(bytes + 9, 4);
+
+  preset.id = Frame::ReadUint(bytes + 5, 4);
+
+  if (preset.id == 0 || size > kMaxSize || size > n - kHeaderSize)
+  {
+    throw std::invalid_argument("Corrupted dictionary");
+  }
+
+  preset.content.assign(reinterpret_cast<const char *>(bytes) + kHeaderSize, size);
+
+  // The tables are optional
+  size_t position = kHeaderSize + size;
+
+  if (position < n)
+  {
+    ParseTable(bytes, n, position, preset.offset_table);
+    ParseTable(bytes, n, position, preset.length_table);
+  }
+
+  if (position != n || preset.offset_table.empty() != preset.length_table.empty())
+  {
+    throw std::invalid_argument("Corrupted dictionary");
+  }
+
+  return preset;
+}
+
+Dictionary::Preset Dictionary::Load(std::string file_path)
+{
+  std::ifstream file(file_path, std::ios::in | std::ios::binary);
+
+  if (!file)
+  {
+    throw std::invalid_argument("Dictionary not found");
+  }
+
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+
+  return Parse(bytes.data(), bytes.size());
+}
+
+void Dictionary::Save(const Preset &preset, std::string file_path)
+{
+  std::vector<uint8_t> bytes;
+  std::ofstream file(file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+  Serialize(preset, bytes);
+  file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+
+  if (!file)
+  {
+    throw std::invalid_argument("Dictionary could not be written");
+  }
+}
+
+// Frequency table index of the d bytes at data,
+// a multiplicative hash as FASTCOVER does
+static uint32_t HashDmer(const uint8_t *data, size_t d)
+{
+  uint64_t value = 0;
+
+  for (size_t i = 0; i < d; i++)
+  {
+    value = (value << 8) | data[i];
+  }
+
+  return (value * 0xCF1BBCDCB7A56463ULL) >> (64 - kHashBits);
+}
+
+// Keeps the first error of the pool tasks, which must
+// not throw, to be thrown once they are all done
+class TaskErrors
+{
+private:
+  std::mutex mutex_;
+  std::exception_ptr error_;
+
+public:
+  //! Wraps a task, catching what it throws
+  std::function<void()> Guard(std::function<void()> task)
+  {
+    return [this, task]()
+    {
+      try
+      {
+        task();
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(this->mutex_);
+
+        if (!this->error_)
+        {
+          this->error_ = std::current_exception();
+        }
+      }
+    };
+  }
+
+  //! Throws the first error, if any
+  void Rethrow()
+  {
+    if (this->error_)
+    {
+      std::rethrow_exception(this->error_);
+    }
+  }
+};
+
+// Indexes of the d-mers of the training bytes and how
+// often each index occurs, counted by the pool workers
+struct Dmers
+{
+  size_t d;
+  std::vector<uint32_t> hashes;
+  std::vector<uint32_t> frequencies;
+};
+
+static void CountDmers(const std::string &corpus, Dmers &dmers,
+                       ThreadPool::WorkStealingPool &pool)
+{
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(corpus.data());
+  size_t n_dmers = corpus.size() - dmers.d + 1;
+  size_t n_shards = pool.Size();
+  std::vector<std::vector<uint32_t>> counts(n_shards);
+  TaskErrors errors;
+
+  dmers.hashes.resize(n_dmers);
+
+  for (size_t shard = 0; shard < n_shards; shard++)
+  {
+    pool.Submit(errors.Guard([&, shard]()
+                {
+                  size_t begin = n_dmers * shard / n_shards;
+                  size_t end = n_dmers * (shard + 1) / n_shards;
+
+                  counts[shard].assign(size_t(1) << kHashBits, 0);
+
+                  for (size_t i = begin; i < end; i++)
+                  {
+                    dmers.hashes[i] = HashDmer(data + i, dmers.d);
+                    counts[shard][dmers.hashes[i]]++;
+                  }
+                }));
+  }
+
+  pool.Wait();
+  errors.Rethrow();
+
+  dmers.frequencies = std::move(counts[0]);
+
+  for (size_t shard = 1; shard < n_shards; shard++)
+  {
+    for (size_t h = 0; h < dmers.frequencies.size(); h++)
+    {
+      dmers.frequencies[h] += counts[shard][h];
+    }
+  }
+}
+
+// Fills a dictionary of size bytes with the best segment of
+// k bytes of each epoch, round after round, the first chosen
+// at its end where the matches are the shortest to reach
+static std::string SelectSegments(const std::string &corpus, const Dmers &dmers,
+                                  size_t k, size_t size)
+{
+  std::vector<uint32_t> frequencies = dmers.frequencies;
+  std::vector<uint32_t> window(frequencies.size(), 0);
+  std::string content(size, 0);
+  size_t tail = size;
+
+  size_t n_dmers = dmers.hashes.size();
+  size_t dmers_per_segment = k - dmers.d + 1;
+  size_t n_epochs = std::max<size_t>(1, std::min(size / k, n_dmers / k));
+  size_t epoch_size = n_dmers / n_epochs;
+  bool selected = true;
+
+  while (tail > 0 && selected)
+  {
+    selected = false;
+
+    for (size_t epoch = 0; epoch < n_epochs && tail > 0; epoch++)
+    {
+      size_t begin = epoch * epoch_size;
+      size_t end = epoch + 1 == n_epochs ? n_dmers : begin + epoch_size;
+
+      // The window score adds the frequency of each
+      // distinct d-mer it holds
+      uint64_t score = 0, best_score = 0;
+      size_t active = begin, best_begin = begin, best_end = begin;
+
+      for (size_t i = begin; i < end; i++)
+      {
+        uint32_t h = dmers.hashes[i];
+
+        if (window[h]++ == 0)
+        {
+          score += frequencies[h];
+        }
+
+        if (i - active + 1 > dmers_per_segment)
+        {
+          uint32_t old = dmers.hashes[active++];
+
+          if (--window[old] == 0)
+          {
+            score -= frequencies[old];
+          }
+        }
+
+        if (score > best_score)
+        {
+          best_score = score;
+          best_begin = active;
+          best_end = i;
+        }
+      }
+
+      for (size_t i = active; i < end; i++)
+      {
+        window[dmers.hashes[i]] = 0;
+      }
+
+      if (best_score == 0)
+      {
+        continue;
+      }
+
+      // Trims from both ends the d-mers an earlier
+      // segment covered, their frequency is zeroed
+      while (frequencies[dmers.hashes[best_begin]] == 0)
+      {
+        best_begin++;
+      }
+
+      while (frequencies[dmers.hashes[best_end]] == 0)
+      {
+        best_end--;
+      }
+
+      // Covered d-mers are worth nothing to the next segments
+      for (size_t i = best_begin; i <= best_end; i++)
+      {
+        frequencies[dmers.hashes[i]] = 0;
+      }
+
+      size_t n = std::min(best_end - best_begin + dmers.d, tail);
+
+      tail -= n;
+      std::copy_n(corpus.begin() + best_begin, n, content.begin() + tail);
+      selected = true;
+    }
+  }
+
+  return content.substr(tail);
+}
+
+// Bytes the samples take compressed with the dictionary
+static uint64_t MeasureDictionary(const std::string &content,
+                                  const std::vector<const std::string *> &samples)
+{
+  LZ77::EncoderContext context;
+  std::vector<uint8_t> output;
+  uint64_t total = 0;
+
+  context.SetDictionary(Dictionary::Create(content.data(), content.size()));
+
+  for (const std::string *sample : samples)
+  {
+    output.resize(LZ77::CompressBound(sample->size()));
+    total += context.Compress(sample->data(), sample->size(),
+                              output.data(), output.size());
+  }
+
+  return total;
+}
+
+// Huffman codes of the symbols, every one of them
+// counted once more so none is left without code
+static std::map<std::string, std::string> BuildTable(std::vector<uint16_t> &symbols,
+                                                     uint16_t max_symbol)
+{
+  Huffman::Encoder huffman_encoder;
+
+  for (uint16_t symbol = 0; symbol <= max_symbol; symbol++)
+  {
+    symbols.push_back(symbol);
+  }
+
+  huffman_encoder.FillBuffer(symbols.data(), symbols.size());
+  huffman_encoder.ComputeProbabilityTable();
+  huffman_encoder.ComputeHuffmanCode();
+
+  return huffman_encoder.GetSymbolEncode();
+}
+
+Dictionary::Preset Dictionary::Train(const std::vector<std::string> &samples,
+                                     const TrainSettings &settings)
+{
+  if (samples.empty())
+  {
+    throw std::invalid_argument("No samples to train the dictionary from");
+  }
+
+  size_t size = std::min(settings.dictionary_size, kMaxSize);
+  ThreadPool::WorkStealingPool pool(std::max(1u, settings.threads));
+
+  // The dictionaries are built from most samples
+  // and measured on the others
+  std::string corpus;
+  std::vector<const std::string *> tests;
+
+  for (size_t i = 0; i < samples.size(); i++)
+  {
+    if (samples.size() >= kTestInterval && i % kTestInterval == 0 &&
+        tests.size() < kMaxTestSamples)
+    {
+      tests.push_back(&samples[i]);
+    }
+
+    else
+    {
+      corpus += samples[i];
+    }
+  }
+
+  if (tests.empty())
+  {
+    for (const std::string &sample : samples)
+    {
+      tests.push_back(&sample);
+    }
+  }
+
+  std::string content = corpus.substr(corpus.size() - std::min(corpus.size(), size));
+
+  // Each segment and d-mer sizes pair is a dictionary,
+  // the best compressing one is kept
+  if (corpus.size() > size)
+  {
+    std::vector<Dmers> dmers;
+
+    for (size_t d : settings.dmer_sizes)
+    {
+      if (d >= 2 && d <= 8 && d < corpus.size())
+      {
+        dmers.push_back({d, {}, {}});
+        CountDmers(corpus, dmers.back(), pool);
+      }
+    }
+
+    struct Candidate
+    {
+      size_t k;
+      const Dmers *dmers;
+      std::string content;
+      uint64_t compressed_size;
+    };
+
+    std::vector<Candidate> candidates;
+
+    for (const Dmers &dmer : dmers)
+    {
+      for (size_t k : settings.segment_sizes)
+      {
+        if (k >= dmer.d && k <= size && k <= dmer.hashes.size())
+        {
+          candidates.push_back({k, &dmer, "", UINT64_MAX});
+        }
+      }
+    }
+
+    TaskErrors errors;
+
+    for (Candidate &candidate : candidates)
+    {
+      pool.Submit(errors.Guard([&]()
+                  {
+                    candidate.content = SelectSegments(corpus, *candidate.dmers,
+                                                       candidate.k, size);
+                    candidate.compressed_size = MeasureDictionary(candidate.content, tests);
+                  }));
+    }
+
+    pool.Wait();
+    errors.Rethrow();
+
+    uint64_t best_size = MeasureDictionary(content, tests);
+
+    for (const Candidate &candidate : candidates)
+    {
+      if (candidate.compressed_size < best_size)
+      {
+        best_size = candidate.compressed_size;
+        content = candidate.content;
+      }
+    }
+  }
+
+  Preset preset = Create(content.data(), content.size());
+
+  // The default tables code the triples of the
+  // samples compressed with the dictionary
+  size_t step = (samples.size() + kMaxTableSamples - 1) / kMaxTableSamples;
+  size_t n_shards = pool.Size();
+  std::vector<uint16_t> offsets, lengths;
+  std::mutex mutex;
+  TaskErrors errors;
+
+  for (size_t shard = 0; shard < n_shards; shard++)
+  {
+    pool.Submit(errors.Guard([&, shard]()
+                {
+                  LZ77::Encoder encoder;
+                  std::vector<uint16_t> shard_offsets, shard_lengths;
+
+                  encoder.SetDictionary(preset);
+
+                  for (size_t i = shard * step; i < samples.size(); i += n_shards * step)
+                  {
+                    encoder.Reset();
+                    encoder.FillBuffer(samples[i].data(), samples[i].size());
+                    encoder.Encode();
+
+                    const LZ77::TokenBuffer &tokens = encoder.GetTokens();
+
+                    shard_offsets.insert(shard_offsets.end(), tokens.offsets.begin(),
+                                         tokens.offsets.end());
+                    shard_lengths.insert(shard_lengths.end(), tokens.lengths.begin(),
+                                         tokens.lengths.end());
+                  }
+
+                  std::lock_guard<std::mutex> lock(mutex);
+
+                  offsets.insert(offsets.end(), shard_offsets.begin(), shard_offsets.end());
+                  lengths.insert(lengths.end(), shard_lengths.begin(), shard_lengths.end());
+                }));
+  }
+
+  pool.Wait();
+  errors.Rethrow();
+
+  preset.offset_table = BuildTable(offsets, LZ77::kSearchBufferSize);
+  preset.length_table = BuildTable(lengths, LZ77::kLookAheadBufferSize);
+
+  return preset;
+}
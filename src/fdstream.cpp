@@ -0,0 +1,273 @@
+#include "../include/fdstream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+FdStream::FdStreamBuf::FdStreamBuf(int fd, size_t buffer_size, bool owns_fd)
+    : fd_(fd),
+      owns_fd_(owns_fd),
+      buffers_{Buffer(buffer_size), Buffer(buffer_size)},
+      current_(0),
+      in_flight_{false, false},
+      written_{0, 0},
+      to_write_{0, 0},
+      offset_(lseek(fd, 0, SEEK_CUR)),
+      mode_(kIdle),
+      end_of_file_(false),
+      failed_(false)
+{
+  char *const buffers[2] = {this->buffers_[0].data(), this->buffers_[1].data()};
+
+  this->queue_ = AsyncIO::Open(buffers, 2, buffer_size);
+
+  // Nothing read and nothing pending
+  this->setg(this->buffers_[0].data(), this->buffers_[0].data(), this->buffers_[0].data());
+  this->setp(this->buffers_[0].data(), this->buffers_[0].data() + buffer_size);
+}
+
+FdStream::FdStreamBuf::~FdStreamBuf()
+{
+  // The buffers are not freed under a request
+  if (this->fd_ >= 0)
+  {
+    this->Close();
+  }
+}
+
+bool FdStream::FdStreamBuf::Close()
+{
+  bool written = this->mode_ != kWriting || this->sync() == 0;
+
+  for (int i = 0; i < 2; i++)
+  {
+    if (this->in_flight_[i])
+    {
+      this->queue_->Wait(i);
+      this->in_flight_[i] = false;
+    }
+  }
+
+  if (this->owns_fd_ && this->fd_ >= 0 && close(this->fd_) != 0)
+  {
+    written = false;
+  }
+
+  this->fd_ = -1;
+
+  return written && !this->failed_;
+}
+
+void FdStream::FdStreamBuf::Submit(int buffer, AsyncIO::Operation operation)
+{
+  Buffer &bytes = this->buffers_[buffer];
+  size_t start = operation == AsyncIO::kRead ? 0 : this->written_[buffer];
+  size_t n = operation == AsyncIO::kRead ? bytes.size()
+                                         : this->to_write_[buffer] - start;
+
+  this->queue_->Submit(buffer, operation, this->fd_, bytes.data() + start, n,
+                       this->offset_);
+  this->in_flight_[buffer] = true;
+}
+
+size_t FdStream::FdStreamBuf::WaitRead(int buffer)
+{
+  int64_t count = this->queue_->Wait(buffer);
+
+  this->in_flight_[buffer] = false;
+
+  // End of input or error
+  if (count <= 0)
+  {
+    this->end_of_file_ = true;
+    this->failed_ = this->failed_ || count < 0;
+    return 0;
+  }
+
+  if (this->offset_ >= 0)
+  {
+    this->offset_ += count;
+  }
+
+  return count;
+}
+
+bool FdStream::FdStreamBuf::WaitWrite(int buffer)
+{
+  while (this->in_flight_[buffer])
+  {
+    int64_t count = this->queue_->Wait(buffer);
+
+    this->in_flight_[buffer] = false;
+
+    if (count <= 0)
+    {
+      this->failed_ = true;
+      break;
+    }
+
+    if (this->offset_ >= 0)
+    {
+      this->offset_ += count;
+    }
+
+    this->written_[buffer] += count;
+
+    // Short writes go on from where they stopped
+    if (this->written_[buffer] < this->to_write_[buffer])
+    {
+      this->Submit(buffer, AsyncIO::kWrite);
+    }
+  }
+
+  return !this->failed_;
+}
+
+bool FdStream::FdStreamBuf::FlushBuffer()
+{
+  size_t pending = this->pptr() - this->pbase();
+
+  if (pending == 0)
+  {
+    return !this->failed_;
+  }
+
+  this->mode_ = kWriting;
+
+  // A single write in flight keeps pipes in order
+  int previous = this->current_ ^ 1;
+
+  if (!this->WaitWrite(previous))
+  {
+    return false;
+  }
+
+  this->written_[this->current_] = 0;
+  this->to_write_[this->current_] = pending;
+  this->Submit(this->current_, AsyncIO::kWrite);
+
+  Buffer &next = this->buffers_[previous];
+
+  this->current_ = previous;
+  this->setp(next.data(), next.data() + next.size());
+
+  return true;
+}
+
+FdStream::FdStreamBuf::int_type FdStream::FdStreamBuf::underflow()
+{
+  if (this->gptr() < this->egptr())
+  {
+    return traits_type::to_int_type(*this->gptr());
+  }
+
+  if (this->end_of_file_)
+  {
+    return traits_type::eof();
+  }
+
+  // The first read has nothing to overlap with
+  if (this->mode_ == kIdle)
+  {
+    this->mode_ = kReading;
+    this->Submit(this->current_ ^ 1, AsyncIO::kRead);
+  }
+
+  this->current_ ^= 1;
+
+  Buffer &bytes = this->buffers_[this->current_];
+  size_t count = this->WaitRead(this->current_);
+
+  this->setg(bytes.data(), bytes.data(), bytes.data() + count);
+
+  if (count == 0)
+  {
+    return traits_type::eof();
+  }
+
+  // The other buffer is consumed, the next bytes
+  // are read into it while these are
+  this->Submit(this->current_ ^ 1, AsyncIO::kRead);
+
+  return traits_type::to_int_type(*this->gptr());
+}
+
+FdStream::FdStreamBuf::int_type FdStream::FdStreamBuf::overflow(int_type c)
+{
+  if (!this->FlushBuffer())
+  {
+    return traits_type::eof();
+  }
+
+  if (!traits_type::eq_int_type(c, traits_type::eof()))
+  {
+    *this->pptr() = traits_type::to_char_type(c);
+    this->pbump(1);
+  }
+
+  return traits_type::not_eof(c);
+}
+
+int FdStream::FdStreamBuf::sync()
+{
+  if (this->mode_ == kReading)
+  {
+    return 0;
+  }
+
+  bool written = this->FlushBuffer();
+
+  for (int i = 0; i < 2; i++)
+  {
+    written = this->WaitWrite(i) && written;
+  }
+
+  return written ? 0 : -1;
+}
+
+// Every byte passes through the buffers, a direct
+// request would overtake the one in flight
+std::streamsize FdStream::FdStreamBuf::xsgetn(char *bytes, std::streamsize n)
+{
+  std::streamsize total = 0;
+
+  while (total < n)
+  {
+    if (this->gptr() == this->egptr() &&
+        traits_type::eq_int_type(this->underflow(), traits_type::eof()))
+    {
+      break;
+    }
+
+    std::streamsize buffered = std::min<std::streamsize>(n - total,
+                                                         this->egptr() - this->gptr());
+
+    std::memcpy(bytes + total, this->gptr(), buffered);
+    this->gbump(buffered);
+    total += buffered;
+  }
+
+  return total;
+}
+
+std::streamsize FdStream::FdStreamBuf::xsputn(const char *bytes, std::streamsize n)
+{
+  std::streamsize total = 0;
+
+  while (total < n)
+  {
+    if (this->pptr() == this->epptr() && !this->FlushBuffer())
+    {
+      break;
+    }
+
+    std::streamsize room = std::min<std::streamsize>(n - total,
+                                                     this->epptr() - this->pptr());
+
+    std::memcpy(this->pptr(), bytes + total, room);
+    this->pbump(room);
+    total += room;
+  }
+
+  return total;
+}
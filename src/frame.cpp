@@ -0,0 +1,149 @@
+#include "../include/frame.h"
+#include "../include/checksum.h"
+
+#include <stdexcept>
+
+void Frame::WriteUint(uint64_t value, int n_bytes, std::vector<uint8_t> &output)
+{
+  for (int i = n_bytes - 1; i >= 0; i--)
+  {
+    output.push_back((value >> (8 * i)) & 0xFF);
+  }
+}
+
+uint64_t Frame::ReadUint(const uint8_t *bytes, int n_bytes)
+{
+  uint64_t value = 0;
+
+  for (int i = 0; i < n_bytes; i++)
+  {
+    value = (value << 8) | bytes[i];
+  }
+
+  return value;
+}
+
+size_t Frame::FrameHeaderSize(uint8_t flags)
+{
+  return Frame::kFrameHeaderSize +
+         ((flags & Frame::kDictionary) ? Frame::kDictionaryIdSize : 0);
+}
+
+void Frame::WriteFrameHeader(const FrameHeader &header, std::vector<uint8_t> &output)
+{
+  Frame::WriteUint(Frame::kMagic, 4, output);
+  Frame::WriteUint(header.version, 1, output);
+  Frame::WriteUint(header.flags, 1, output);
+  Frame::WriteUint(header.block_size, 4, output);
+
+  if (header.flags & Frame::kDictionary)
+  {
+    Frame::WriteUint(header.dictionary_id, Frame::kDictionaryIdSize, output);
+  }
+}
+
+Frame::FrameHeader Frame::ParseFrameHeader(const uint8_t *bytes)
+{
+  FrameHeader header;
+
+  if (Frame::ReadUint(bytes, 4) != Frame::kMagic)
+  {
+    throw std::invalid_argument("The input is not a .lz77 file");
+  }
+
+  header.version = bytes[4];
+  header.flags = bytes[5];
+  header.block_size = Frame::ReadUint(bytes + 6, 4);
+
+  if (header.version != Frame::kVersion)
+  {
+    throw std::invalid_argument("Unsupported .lz77 version");
+  }
+
+  return header;
+}
+
+uint32_t Frame::ParseDictionaryId(const uint8_t *bytes)
+{
+  return Frame::ReadUint(bytes, Frame::kDictionaryIdSize);
+}
+
+size_t Frame::BlockHeaderSize(uint8_t frame_flags)
+{
+  return Frame::kBlockHeaderSize +
+         ((frame_flags & Frame::kContentChecksum) ? Frame::kChecksumSize : 0);
+}
+
+void Frame::WriteBlockHeader(const BlockHeader &header, uint8_t frame_flags,
+                             std::vector<uint8_t> &output)
+{
+  Frame::WriteUint(header.raw_size, 4, output);
+  Frame::WriteUint(header.compressed_size, 4, output);
+  Frame::WriteUint(header.flags, 1, output);
+
+  if (frame_flags & Frame::kContentChecksum)
+  {
+    Frame::WriteUint(header.checksum, 8, output);
+  }
+}
+
+Frame::BlockHeader Frame::ParseBlockHeader(const uint8_t *bytes, uint8_t frame_flags)
+{
+  BlockHeader header;
+
+  header.raw_size = Frame::ReadUint(bytes, 4);
+  header.compressed_size = Frame::ReadUint(bytes + 4, 4);
+  header.flags = bytes[8];
+  header.checksum = 0;
+
+  if (frame_flags & Frame::kContentChecksum)
+  {
+    header.checksum = Frame::ReadUint(bytes + Frame::kBlockHeaderSize, 8);
+  }
+
+  return header;
+}
+
+uint64_t Frame::FrameChecksum(const std::vector<uint64_t> &block_checksums)
+{
+  std::vector<uint8_t> bytes;
+
+  for (auto checksum : block_checksums)
+  {
+    Frame::WriteUint(checksum, 8, bytes);
+  }
+
+  return Checksum::XXH64(bytes.data(), bytes.size());
+}
+
+void Frame::WriteEndMark(std::vector<uint8_t> &output)
+{
+  Frame::WriteUint(0, 4, output);
+}
+
+void Frame::WriteIndex(const std::vector<IndexEntry> &index, std::vector<uint8_t> &output)
+{
+  for (auto const &entry : index)
+  {
+    Frame::WriteUint(entry.raw_offset, 8, output);
+    Frame::WriteUint(entry.compressed_offset, 8, output);
+  }
+
+  // Trailer
+  Frame::WriteUint(index.size(), 4, output);
+  Frame::WriteUint(index.size() * Frame::kIndexEntrySize + Frame::kIndexTrailerSize,
+                   4, output);
+}
+
+std::vector<Frame::IndexEntry> Frame::ParseIndex(const uint8_t *bytes, size_t n_entries)
+{
+  std::vector<IndexEntry> index(n_entries);
+
+  for (size_t i = 0; i < n_entries; i++)
+  {
+    index[i].raw_offset = Frame::ReadUint(bytes + i * kIndexEntrySize, 8);
+    index[i].compressed_offset = Frame::ReadUint(bytes + i * kIndexEntrySize + 8, 8);
+  }
+
+  return index;
+}
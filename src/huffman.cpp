@@ -3,18 +3,19 @@
 #include "../include/lz77.h"
 #define DEBUG 0
 #define DECODE_DEBUG 0
+#define RATE_DEBUG 0
 
-int Huffman::Encoder::HowManyCharacters()
+uint64_t Huffman::Encoder::HowManyCharacters()
 {
   return this->character_counter_;
 }
 
-int Huffman::Encoder::CharactersQuantity()
+uint64_t Huffman::Encoder::CharactersQuantity()
 {
   return this->character_counter_;
 }
 
-void Huffman::Encoder::CountCharacters(int n_characters)
+void Huffman::Encoder::CountCharacters(uint64_t n_characters)
 {
   this->character_counter_ += n_characters;
 }
@@ -85,13 +86,23 @@ void Huffman::Encoder::FlushProbabilityTableAsCSV(std::string file_name)
 
 void Huffman::Encoder::FillBuffer(std::vector<int> buffer)
 {
-  // Gets each single string from buffer
-  for (auto const &content : buffer)
+  // Symbols are 16 bits words
+  std::vector<uint16_t> words(buffer.begin(), buffer.end());
+
+  this->FillBuffer(words.data(), words.size());
+}
+
+void Huffman::Encoder::FillBuffer(const uint16_t *buffer, size_t n)
+{
+  this->file_content_.reserve(this->file_content_.size() + 16 * n);
+
+  // Gets each single word from buffer
+  for (size_t j = 0; j < n; j++)
   {
     // Gets each bit from the word
     for (int i = 15; i >= 0; i--)
     {
-      this->file_content_.push_back(((content >> i) & 1));
+      this->file_content_.push_back(((buffer[j] >> i) & 1));
     }
 
     this->CountCharacters(1);
@@ -105,7 +116,7 @@ void Huffman::Encoder::FillBuffer(std::vector<int> buffer)
   std::string word_bitstream = "";
 
   // Counts symbols
-  for (uint base = 0; base < file_buffer.size(); base += 16)
+  for (uint64_t base = 0; base < file_buffer.size(); base += 16)
   {
     word_bitstream.clear();
 
@@ -144,7 +155,7 @@ void Huffman::Encoder::FillBuffer(std::vector<std::string> buffer)
   std::string word_bitstream = "";
 
   // Counts symbols
-  for (uint base = 0; base < file_buffer.size(); base += 16)
+  for (uint64_t base = 0; base < file_buffer.size(); base += 16)
   {
     word_bitstream.clear();
 
@@ -242,11 +253,20 @@ void Huffman::Encoder::ComputeHuffmanCode()
   }
 
   // The remaining symbols will initiate
-  // the code pattern
-  auto it = symbol_vector.begin();
-  auto next = symbol_vector.begin() + 1;
-  code_map[it->second] = "1";
-  code_map[next->second] = "0";
+  // the code pattern. A source with a single
+  // symbol still needs a 1 bit code
+  if (symbol_vector.size() == 2)
+  {
+    auto it = symbol_vector.begin();
+    auto next = symbol_vector.begin() + 1;
+    code_map[it->second] = "1";
+    code_map[next->second] = "0";
+  }
+
+  else if (symbol_vector.size() == 1)
+  {
+    code_map[symbol_vector.front().second] = "1";
+  }
 
   std::reverse(father.begin(), father.end());
   std::reverse(combined_pairs.begin(), combined_pairs.end());
@@ -322,10 +342,6 @@ void Huffman::Encoder::ComputeHuffmanCode()
 
   this->entropy_ = entropy;
 
-  std::cout << "Entropy:\t"
-            << entropy
-            << " bits/symbol\n";
-
   // Bits per symbol in new encoding
   double average_rate = 0;
 
@@ -335,16 +351,6 @@ void Huffman::Encoder::ComputeHuffmanCode()
   }
 
   this->average_rate_ = average_rate;
-
-  std::cout
-      << "Average size:\t"
-      << average_rate
-      << " bits/symbol\n";
-
-  std::cout
-      << "Difference:\t"
-      << (this->average_rate_ - this->entropy_)
-      << " bits/symbol\n";
 }
 
 void Huffman::Encoder::Encode()
@@ -353,7 +359,7 @@ void Huffman::Encoder::Encode()
   std::string encoded_symbol = "";
   std::string bit = "";
 
-  for (uint base = 0; base < this->file_content_.size(); base += 8)
+  for (uint64_t base = 0; base < this->file_content_.size(); base += 8)
   {
     byte_bitstream.clear();
     encoded_symbol.clear();
@@ -433,20 +439,23 @@ void Huffman::Encoder::Encode()
 
   compression_rate *= 100;
 
-  std::cout
-      << "Original file size:\t\t\t"
-      << this->file_content_.size() / 8
-      << " bytes\n";
-
-  std::cout
-      << "Compressed file size without overhead:\t"
-      << this->encoded_data_.size() / 8
-      << " bytes\n";
-
-  std::cout
-      << "Liquid Compression rate: "
-      << compression_rate
-      << "%\n";
+  if (RATE_DEBUG)
+  {
+    std::cout
+        << "Original file size:\t\t\t"
+        << this->file_content_.size() / 8
+        << " bytes\n";
+
+    std::cout
+        << "Compressed file size without overhead:\t"
+        << this->encoded_data_.size() / 8
+        << " bytes\n";
+
+    std::cout
+        << "Liquid Compression rate: "
+        << compression_rate
+        << "%\n";
+  }
 }
 
 std::vector<std::string> Huffman::Encoder::GetEncodedContent()
@@ -458,7 +467,7 @@ std::vector<std::string> Huffman::Encoder::GetEncodedContent()
 
   this->codes_size_ = 0;
 
-  for (uint base = 0; base < this->file_content_.size(); base += 8)
+  for (uint64_t base = 0; base < this->file_content_.size(); base += 8)
   {
     byte_bitstream.clear();
     encoded_symbol.clear();
@@ -528,7 +537,7 @@ void Huffman::Encoder::CompressToFile(std::string file_name)
   }
 
   // Inserts the encoded data
-  for (uint i = 0; i < this->encoded_data_.size(); i++)
+  for (uint64_t i = 0; i < this->encoded_data_.size(); i++)
   {
     bstream.writeBit(this->encoded_data_[i]);
     bstream_vector.push_back(this->encoded_data_[i]);
@@ -598,7 +607,7 @@ void Huffman::Decoder::Decode()
 
   // Current bit set to read
   // in the encoded_content_buffer
-  int current_bit = 0;
+  uint64_t current_bit = 0;
 
   // Symbol read from the header
   std::string symbol;
@@ -1,16 +1,171 @@
 #include "../include/lz77.h"
 #include "../include/huffman.h"
 #include "../include/bitstream.h"
+#include "../include/frame.h"
+#include "../include/checksum.h"
+#include "../include/stats.h"
+#include "../include/trace.h"
 #include "errno.h"
 
+#include <atomic>
+#include <cassert>
+#include <thread>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
 #define FOR 0
 #define DEBUG 0
 #define DEBUG_DECODE 0
 #define TRIPLES_DEBUG 0
-#define DEBUG_COMPRESSED_BSTREAM 0
 #define EXPORT_HISTOGRAM 0
 #define ENCODE_CODEWORD 0
 
+// Links and color of a tree node, as held by the
+// std::set and std::map the accounts estimate
+static const uint64_t kTreeNodeBytes = 4 * sizeof(void *);
+
+// Bytes of a std::string of length bytes, its
+// characters live in it up to the SSO capacity
+static uint64_t StringBytes(uint64_t length)
+{
+  return sizeof(std::string) + (length > 15 ? length + 1 : 0);
+}
+
+// Original size bit marking a content compressed
+// with a dictionary, whose identifier follows
+static const uint64_t kDictionaryFlag = uint64_t(1) << 63;
+
+// Original size bit marking a content coded with the
+// dictionary tables, without Huffman headers
+static const uint64_t kDictionaryTablesFlag = uint64_t(1) << 62;
+
+void LZ77::TokenBuffer::Reserve(size_t n)
+{
+  this->offsets.reserve(n);
+  this->lengths.reserve(n);
+  this->literals.reserve(n);
+}
+
+void LZ77::TokenBuffer::Clear()
+{
+  this->offsets.clear();
+  this->lengths.clear();
+  this->literals.clear();
+}
+
+void LZ77::CodeTable::Assign(
+    const std::map<std::string, std::string> &symbol_encode)
+{
+  this->codes.clear();
+  this->sizes.clear();
+
+  for (auto const &p : symbol_encode)
+  {
+    uint64_t symbol = 0;
+    uint64_t code = 0;
+
+    // Codes longer than 64 bits, which no block
+    // reaches, only come from a corrupted table
+    if (p.first.size() > 16 || p.second.empty() || p.second.size() > 64)
+    {
+      throw std::invalid_argument("Invalid Huffman table");
+    }
+
+    for (char bit : p.first)
+    {
+      symbol = (symbol << 1) | (bit == '1');
+    }
+
+    for (char bit : p.second)
+    {
+      code = (code << 1) | (bit == '1');
+    }
+
+    if (symbol >= this->sizes.size())
+    {
+      this->codes.resize(symbol + 1, 0);
+      this->sizes.resize(symbol + 1, 0);
+    }
+
+    this->codes[symbol] = code;
+    this->sizes[symbol] = p.second.size();
+  }
+}
+
+LZ77::Encoder::Encoder()
+    : sequence_position_(this->allocator_),
+      search_buffer_tree_(this->allocator_),
+      preset_tree_(this->preset_allocator_),
+      preset_positions_(this->preset_allocator_)
+{
+}
+
+void LZ77::Encoder::Reset()
+{
+  // The arena blocks are given back before it forgets them
+  this->search_buffer_tree_.clear();
+  this->sequence_position_.clear();
+  this->nodes_to_exclude.clear();
+  this->arena_.Reset();
+
+  this->tokens_.Clear();
+  this->file_content_.clear();
+  this->history_size_ = 0;
+  this->dictionary_history_ = false;
+  this->output_encoding_.clear();
+  this->symbol_table_.clear();
+  this->symbol_table_ready_ = false;
+  this->offset_symbol_encode_.clear();
+  this->length_symbol_encode_.clear();
+  this->offset_codes_ = CodeTable();
+  this->length_codes_ = CodeTable();
+}
+
+void LZ77::Encoder::SetDictionary(const Dictionary::Preset &dictionary)
+{
+  this->Reset();
+  this->preset_tree_.clear();
+  this->preset_positions_.clear();
+  this->preset_nodes_.clear();
+  this->preset_arena_.Reset();
+  this->dictionary_ = dictionary;
+  this->dictionary_offset_codes_.Assign(dictionary.offset_table);
+  this->dictionary_length_codes_.Assign(dictionary.length_table);
+
+  if (dictionary.content.empty())
+  {
+    return;
+  }
+
+  // Seeded from the dictionary alone, the nodes of
+  // its last positions end with it
+  this->FillBuffer(dictionary.content.data(), dictionary.content.size(), nullptr, 0);
+  this->SeedSearchBufferTree();
+
+  for (const ArenaString &node : this->search_buffer_tree_)
+  {
+    this->preset_tree_.emplace_hint(this->preset_tree_.end(), node,
+                                    this->preset_allocator_);
+  }
+
+  for (const auto &node : this->sequence_position_)
+  {
+    this->preset_positions_.emplace_hint(
+        this->preset_positions_.end(), std::piecewise_construct,
+        std::forward_as_tuple(node.first, this->preset_allocator_),
+        std::forward_as_tuple(node.second));
+  }
+
+  for (const ArenaString &node : this->nodes_to_exclude)
+  {
+    this->preset_nodes_.emplace_back(node, this->preset_allocator_);
+  }
+
+  this->Reset();
+}
+
 void LZ77::Encoder::CountSymbol(std::string character)
 {
   this->symbol_table_[character]++;
@@ -18,55 +173,86 @@ void LZ77::Encoder::CountSymbol(std::string character)
 
 std::map<std::string, double> LZ77::Encoder::GetSymbolTable()
 {
+  if (!this->symbol_table_ready_)
+  {
+    this->ComputeProbabilityTable();
+  }
+
   return this->symbol_table_;
 }
 
 void LZ77::Encoder::ComputeProbabilityTable()
 {
-  for (auto &x : this->GetSymbolTable())
+  // Four histograms, so consecutive equal
+  // bytes do not wait on the same counter
+  uint64_t counts[4][256] = {};
+  const uint8_t *content =
+      reinterpret_cast<const uint8_t *>(this->file_content_.data());
+  uint64_t begin = this->history_size_;
+  uint64_t end = this->file_content_.size();
+  uint64_t i = begin;
+
+  for (; i + 4 <= end; i += 4)
+  {
+    counts[0][content[i]]++;
+    counts[1][content[i + 1]]++;
+    counts[2][content[i + 2]]++;
+    counts[3][content[i + 3]]++;
+  }
+
+  for (; i < end; i++)
+  {
+    counts[0][content[i]]++;
+  }
+
+  this->symbol_table_.clear();
+
+  for (int byte = 0; byte < 256; byte++)
   {
-    this->symbol_table_[x.first] /= this->file_content_.size();
+    uint64_t count = counts[0][byte] + counts[1][byte] +
+                     counts[2][byte] + counts[3][byte];
+
+    if (count > 0)
+    {
+      this->symbol_table_[std::string(1, (char)byte)] =
+          (double)count / (end - begin);
+    }
   }
+
+  this->symbol_table_ready_ = true;
 }
 
 void LZ77::Encoder::FillBuffer(std::string file_path)
 {
   // Read file as binary data
-  std::ifstream f(file_path);
-
-  // File's input line read
-  std::string line_read;
-
-  // Single character from file content
-  std::string character;
-
-  char c;
+  std::ifstream f(file_path, std::ios::in | std::ios::binary | std::ios::ate);
 
   // Error, file no found
   if (!f)
   {
-    std::cout << "File not found\n";
-    exit(0);
+    throw std::invalid_argument("File not found");
   };
 
-  // Initializes file content as empty
-  this->file_content_ = "";
+  // Sizes the content once and reads it in a single call
+  std::streamsize file_size = f.tellg();
+
+  this->history_size_ = 0;
+  this->file_content_.resize(file_size);
+  f.seekg(0, std::ios::beg);
+  f.read(&this->file_content_[0], file_size);
 
-  while (f.get(c))
+  if (f.gcount() != file_size)
   {
-    this->file_content_ += c;
+    throw std::invalid_argument("Could not read " + file_path);
   }
+
   f.close();
 
-  // Fills Symbol table
-  for (auto &c : this->file_content_)
-  {
-    character = c;
-    this->CountSymbol(character);
-    character.clear();
-  }
+  this->window_account_.Set(this->file_content_.capacity());
 
-  this->ComputeProbabilityTable();
+  // Statistics are computed on demand
+  this->symbol_table_.clear();
+  this->symbol_table_ready_ = false;
 
 #if DEBUG
   std::cout << "-----------------------------\n"
@@ -84,27 +270,86 @@ void LZ77::Encoder::FillBuffer(std::string file_path)
 #endif
 }
 
+void LZ77::Encoder::FillBuffer(const void *source, size_t n)
+{
+  this->FillBuffer(this->dictionary_.content.data(), this->dictionary_.content.size(),
+                   source, n);
+  this->dictionary_history_ = !this->dictionary_.content.empty();
+}
+
+void LZ77::Encoder::FillBuffer(const void *history, size_t history_size,
+                               const void *source, size_t n)
+{
+  this->history_size_ = history_size;
+  this->dictionary_history_ = false;
+  this->file_content_.reserve(history_size + n);
+  this->file_content_.assign(static_cast<const char *>(history), history_size);
+  this->file_content_.append(static_cast<const char *>(source), n);
+
+  this->window_account_.Set(this->file_content_.capacity());
+
+  // Statistics are computed on demand
+  this->symbol_table_.clear();
+  this->symbol_table_ready_ = false;
+}
+
+std::string_view LZ77::Encoder::GetBlock() const
+{
+  return std::string_view(this->file_content_).substr(this->history_size_);
+}
+
 void LZ77::Encoder::Encode()
 {
   int offset, length;
 
-  int const last_one = this->file_content_.size() - 1;
+  uint64_t const last_one = this->file_content_.size() - 1;
 
   // Transmited symbol's index
-  int next_symbol_index;
+  uint64_t next_symbol_index;
 
-  triple_struct triple;
-
-  std::string symbol = "";
+  uint8_t symbol;
   this->look_ahead_buffer_ = "";
 
+  // At most a triple per byte to encode
+  this->tokens_.Clear();
+  this->tokens_.Reserve(this->file_content_.size() - this->history_size_);
+
+  // The dictionary nodes are copied from the ones seeded
+  // once, their positions are the same in the content
+  if (this->dictionary_history_)
+  {
+    for (const ArenaString &node : this->preset_tree_)
+    {
+      this->search_buffer_tree_.emplace_hint(this->search_buffer_tree_.end(),
+                                             node, this->allocator_);
+    }
+
+    for (const auto &node : this->preset_positions_)
+    {
+      this->sequence_position_.emplace_hint(
+          this->sequence_position_.end(), std::piecewise_construct,
+          std::forward_as_tuple(node.first, this->allocator_),
+          std::forward_as_tuple(node.second));
+    }
+
+    for (const ArenaString &node : this->preset_nodes_)
+    {
+      this->nodes_to_exclude.emplace_back(node, this->allocator_);
+    }
+  }
+
+  else
+  {
+    this->SeedSearchBufferTree();
+  }
+
 #if FOR
   for (this->current_character_index_ = 0;
        this->current_character_index_ <
        4;
        this->current_character_index_++)
 #else
-  for (this->current_character_index_ = 0;
+  for (this->current_character_index_ = this->history_size_;
        this->current_character_index_ <
        this->file_content_.size();
        this->current_character_index_++)
@@ -119,17 +364,17 @@ void LZ77::Encoder::Encode()
         this->file_content_.size() - 1)
     {
       // Updates lookahead
-      this->look_ahead_buffer_ =
-          this->file_content_.substr(this->current_character_index_,
-                                     this->file_content_.size() - this->current_character_index_);
+      this->look_ahead_buffer_.assign(this->file_content_,
+                                      this->current_character_index_,
+                                      this->file_content_.size() - this->current_character_index_);
     }
 
     else
     {
       // Updates lookahead
-      this->look_ahead_buffer_ =
-          this->file_content_.substr(this->current_character_index_,
-                                     this->look_ahead_buffer_size_);
+      this->look_ahead_buffer_.assign(this->file_content_,
+                                      this->current_character_index_,
+                                      this->look_ahead_buffer_size_);
     }
 
     // std::cout << this->look_ahead_buffer_ << std::endl;
@@ -139,9 +384,6 @@ void LZ77::Encoder::Encode()
 
     next_symbol_index = this->current_character_index_ + length;
 
-    this->offset_sequence_buffer_.push_back(offset);
-    this->length_sequence_buffer_.push_back(length);
-
     // There's a match, but exceeds the
     // content buffer, send only the last symbol
     // in the triple
@@ -164,17 +406,19 @@ void LZ77::Encoder::Encode()
           this->file_content_[next_symbol_index];
     }
 
-    this->codeword_sequence_buffer_.push_back(symbol);
-
     // Next symbol index
     this->current_character_index_ = next_symbol_index;
 
-    triple_struct triple = {offset, length, symbol};
-    this->triples_vector_.push_back(triple);
+    this->tokens_.Push(offset, length, symbol);
+
+    if (Stats::kEnabled)
+    {
+      Stats::RecordTriple(Stats::Local(), offset, length);
+    }
 
 #if DEBUG
     std::cout << "<" << offset << "," << length << ",";
-    std::cout << symbol << ">\n";
+    std::cout << (char)symbol << ">\n";
     std::cout << "Search Buffer tree:"
               << "\n";
     for (auto const &a : this->search_buffer_tree_)
@@ -187,19 +431,31 @@ void LZ77::Encoder::Encode()
 #if TRIPLES_DEBUG
   std::cout << "Output Triples:"
             << "\n";
-  for (auto const &a : this->triples_vector_)
+  for (size_t i = 0; i < this->tokens_.Size(); i++)
   {
     std::cout << "Offset:"
-              << a.offset
+              << this->tokens_.offsets[i]
               << "\nLength:"
-              << a.length
+              << this->tokens_.lengths[i]
               << "\nSymbol:"
-              << a.codeword
+              << (char)this->tokens_.literals[i]
               << std::endl;
   }
 #endif
 }
 
+void LZ77::Encoder::SeedSearchBufferTree()
+{
+  for (this->current_character_index_ =
+           this->history_size_ -
+           std::min<uint64_t>(this->history_size_, this->search_buffer_size_);
+       this->current_character_index_ < this->history_size_;
+       this->current_character_index_++)
+  {
+    this->UpdateSearchBufferTree(0);
+  }
+}
+
 std::tuple<int, int> LZ77::Encoder::MatchPattern()
 {
   // The current match sequence in the lookahead buffer
@@ -236,17 +492,17 @@ std::tuple<int, int> LZ77::Encoder::MatchPattern()
 
 void LZ77::Encoder::UpdateSearchBufferTree(int length)
 {
-  std::string next_to_delete;
+  ArenaString next_to_delete(this->allocator_);
 
   // Next node to be added
   // Current index plus
-  std::string add_node;
+  ArenaString add_node(this->allocator_);
 
   // How many nodes exceeding are occupying
   // the search buffer tree
-  int n_exceed_nodes;
+  uint64_t n_exceed_nodes;
 
-  for (int i = this->current_character_index_;
+  for (uint64_t i = this->current_character_index_;
        i < this->current_character_index_ + length + 1; i++)
   {
     if (i >= this->file_content_.size())
@@ -254,9 +510,9 @@ void LZ77::Encoder::UpdateSearchBufferTree(int length)
       break;
     }
 
-    add_node = this->file_content_.substr(
-        i,
-        this->look_ahead_buffer_size_);
+    add_node.assign(this->file_content_.data() + i,
+                    std::min<uint64_t>(this->look_ahead_buffer_size_,
+                                       this->file_content_.size() - i));
 
     // Inserts in the list of nodes to be deleted
     this->nodes_to_exclude.push_back(add_node);
@@ -269,14 +525,20 @@ void LZ77::Encoder::UpdateSearchBufferTree(int length)
   if (this->search_buffer_tree_.size() > this->search_buffer_size_)
   {
     n_exceed_nodes = this->search_buffer_tree_.size() - this->search_buffer_size_;
-    for (int i = 0;
+    for (uint64_t i = 0;
          i < n_exceed_nodes;
          i++)
     {
 
-      next_to_delete = this->nodes_to_exclude.front();
-      this->nodes_to_exclude.erase(this->nodes_to_exclude.begin());
-      this->search_buffer_tree_.erase(next_to_delete);
+      next_to_delete = std::move(this->nodes_to_exclude.front());
+      this->nodes_to_exclude.pop_front();
+
+      // Every copy leaves the tree, so its
+      // position is not looked up anymore
+      if (this->search_buffer_tree_.erase(next_to_delete) > 0)
+      {
+        this->sequence_position_.erase(next_to_delete);
+      }
     }
   }
 }
@@ -302,7 +564,7 @@ std::tuple<int, int> LZ77::Encoder::SearchMatching()
   // Matching search on tree
   else
   {
-    std::string match = this->SearchBestMatch();
+    ArenaString match = this->SearchBestMatch();
 
     // No match!
     if (match == "")
@@ -320,10 +582,19 @@ std::tuple<int, int> LZ77::Encoder::SearchMatching()
   return std::make_tuple(offset, length);
 }
 
-std::tuple<int, int> LZ77::Encoder::LargestMatch(std::string match_string)
+std::tuple<int, int> LZ77::Encoder::LargestMatch(const ArenaString &match_string)
 {
-  int match_position = this->sequence_position_[match_string];
-  int offset = this->current_character_index_ - match_position;
+  uint64_t match_position = this->sequence_position_[match_string];
+  uint64_t distance = this->current_character_index_ - match_position;
+
+  // The offset is sent in 16 bits, a farther
+  // match can not be represented
+  if (distance > kMaxOffset)
+  {
+    return std::make_tuple(0, 0);
+  }
+
+  int offset = distance;
 
 #if DEBUG
   std::cout << match_string
@@ -333,10 +604,10 @@ std::tuple<int, int> LZ77::Encoder::LargestMatch(std::string match_string)
 #endif
 
   int length = 0;
-  int const last_one = this->file_content_.size() - 1;
+  uint64_t const last_one = this->file_content_.size() - 1;
 
   // Compares each character from each string
-  for (int i = 0; i < match_string.size(); i++)
+  for (uint64_t i = 0; i < match_string.size(); i++)
   {
     if (this->look_ahead_buffer_[i] == match_string[i] &&
         this->current_character_index_ + length < last_one)
@@ -352,17 +623,19 @@ std::tuple<int, int> LZ77::Encoder::LargestMatch(std::string match_string)
   return std::make_tuple(offset, length);
 }
 
-std::string LZ77::Encoder::SearchBestMatch()
+LZ77::ArenaString LZ77::Encoder::SearchBestMatch()
 {
-  std::string current_sequence = "";
+  ArenaString current_sequence(this->allocator_);
 
   int match_length = 0;
-  int i = this->current_character_index_;
-  std::set<std::string>::iterator it, match;
+  int n_probes = 0;
+  uint64_t i = this->current_character_index_;
+  decltype(this->search_buffer_tree_)::iterator it, match;
 
   do
   {
     current_sequence += this->file_content_[i];
+    n_probes++;
 
     it = this->search_buffer_tree_
              .lower_bound(current_sequence);
@@ -384,10 +657,21 @@ std::string LZ77::Encoder::SearchBestMatch()
   } while (match_length < this->look_ahead_buffer_size_ &&
            it != this->search_buffer_tree_.end());
 
+  // Tree lookups and depth of the shared
+  // prefix reached, per position
+  if (Stats::kEnabled)
+  {
+    Stats::Counters &stats = Stats::Local();
+
+    stats.probes += n_probes;
+    stats.depth_total += match_length;
+    stats.depth_max = std::max<uint64_t>(stats.depth_max, match_length);
+  }
+
   // No match found!
   if (match_length == 0)
   {
-    return "";
+    return ArenaString(this->allocator_);
   }
 
   else
@@ -429,172 +713,325 @@ void LZ77::Encoder::FlushProbabilityTableAsCSV()
 
 void LZ77::Encoder::CompressToFile(std::string file_path)
 {
-
   // Empty Bitstream object
   Bitstream bstream;
-  std::string bit;
 
-  // ***** Debug *******
-  std::vector<bool> bstream_vector;
+  this->CompressToBitstream(bstream);
+
+  bstream.flushesToFile(file_path);
+}
+
+void LZ77::Encoder::CompressToBitstream(Bitstream &bstream)
+{
+  uint64_t original_size = this->file_content_.size() - this->history_size_;
+
+  // The dictionary tables spare the content its own tables
+  // and their headers, when they code all its symbols
+  bool dictionary_tables =
+      this->dictionary_history_ && !this->dictionary_.offset_table.empty() &&
+      this->TriplesSize(this->dictionary_offset_codes_,
+                        this->dictionary_length_codes_) != UINT64_MAX;
+
+  if (!dictionary_tables)
+  {
+    this->ComputeTables();
+  }
+
+  if (this->dictionary_history_)
+  {
+    original_size |= kDictionaryFlag;
+  }
+
+  if (dictionary_tables)
+  {
+    original_size |= kDictionaryTablesFlag;
+  }
+
+  // Inserts original size as bits
+  for (int i = 0; i < 64; i++)
+  {
+    bstream.writeBit((original_size >> (63 - i)) & 1);
+  }
+
+  if (this->dictionary_history_)
+  {
+    for (int i = 0; i < 32; i++)
+    {
+      bstream.writeBit((this->dictionary_.id >> (31 - i)) & 1);
+    }
+  }
+
+  if (dictionary_tables)
+  {
+    this->SetTables(this->dictionary_offset_codes_,
+                    this->dictionary_length_codes_);
+    this->WriteTriples(bstream);
+    return;
+  }
+
+  this->WriteTables(bstream);
+  this->WriteTriples(bstream);
+}
 
-  Huffman::Encoder *huffman_encoder_offset = new Huffman::Encoder();
-  Huffman::Encoder *huffman_encoder_length = new Huffman::Encoder();
+void LZ77::Encoder::ComputeTables()
+{
+  Huffman::Encoder huffman_encoder_offset;
+  Huffman::Encoder huffman_encoder_length;
 
 #if ENCODE_CODEWORD
-  Huffman::Encoder *huffman_encoder_codeword = new Huffman::Encoder();
+  Huffman::Encoder huffman_encoder_codeword;
 #endif
 
   // These sequence buffer is the offsets and lengths values
   // written in a single concatenated string(without space).
   // The Huffman code is pass trough these buffer, encoding
   // the offset and lengths to be send.
-  huffman_encoder_offset->FillBuffer(this->offset_sequence_buffer_);
-  huffman_encoder_length->FillBuffer(this->length_sequence_buffer_);
+  huffman_encoder_offset.FillBuffer(this->tokens_.offsets.data(),
+                                    this->tokens_.Size());
+  huffman_encoder_length.FillBuffer(this->tokens_.lengths.data(),
+                                    this->tokens_.Size());
 
 #if ENCODE_CODEWORD
-  huffman_encoder_codeword->FillBuffer(this->codeword_sequence_buffer_);
+  std::vector<std::string> codewords;
+
+  for (uint8_t literal : this->tokens_.literals)
+  {
+    codewords.push_back(std::string(1, literal));
+  }
+
+  huffman_encoder_codeword.FillBuffer(codewords);
 #endif
 
 #if EXPORT_HISTOGRAM
-  huffman_encoder_length->FlushProbabilityTableAsCSV("length");
-  huffman_encoder_offset->FlushProbabilityTableAsCSV("offset");
+  huffman_encoder_length.FlushProbabilityTableAsCSV("length");
+  huffman_encoder_offset.FlushProbabilityTableAsCSV("offset");
 #endif
-  huffman_encoder_offset->ComputeProbabilityTable();
-  huffman_encoder_length->ComputeProbabilityTable();
-
+  huffman_encoder_offset.ComputeProbabilityTable();
+  huffman_encoder_length.ComputeProbabilityTable();
 
 #if ENCODE_CODEWORD
-  huffman_encoder_codeword->ComputeProbabilityTable();
-  huffman_encoder_codeword->ComputeHuffmanCode();
+  huffman_encoder_codeword.ComputeProbabilityTable();
+  huffman_encoder_codeword.ComputeHuffmanCode();
 #endif
 
-  huffman_encoder_offset->ComputeHuffmanCode();
-  huffman_encoder_length->ComputeHuffmanCode();
+  huffman_encoder_offset.ComputeHuffmanCode();
+  huffman_encoder_length.ComputeHuffmanCode();
+
+  this->offset_symbol_encode_ = huffman_encoder_offset.GetSymbolEncode();
+  this->length_symbol_encode_ = huffman_encoder_length.GetSymbolEncode();
+  this->offset_codes_.Assign(this->offset_symbol_encode_);
+  this->length_codes_.Assign(this->length_symbol_encode_);
+  this->AccountTables();
+
+  // Bits the streams would take at their entropy
+  if (Stats::kEnabled)
+  {
+    Stats::Counters &stats = Stats::Local();
+
+    stats.offset_entropy_bits +=
+        huffman_encoder_offset.entropy_ * this->tokens_.Size();
+    stats.length_entropy_bits +=
+        huffman_encoder_length.entropy_ * this->tokens_.Size();
+  }
+}
+
+void LZ77::Encoder::SetTables(const CodeTable &offset_codes,
+                              const CodeTable &length_codes)
+{
+  this->offset_symbol_encode_.clear();
+  this->length_symbol_encode_.clear();
+  this->offset_codes_ = offset_codes;
+  this->length_codes_ = length_codes;
+  this->AccountTables();
+}
+
+void LZ77::Encoder::AccountTables()
+{
+  uint64_t bytes = 0;
+
+  for (const auto *table : {&this->offset_symbol_encode_, &this->length_symbol_encode_})
+  {
+    for (auto const &p : *table)
+    {
+      bytes += kTreeNodeBytes + StringBytes(p.first.size()) +
+               StringBytes(p.second.size());
+    }
+  }
+
+  for (const CodeTable *table : {&this->offset_codes_, &this->length_codes_})
+  {
+    bytes += table->codes.capacity() * sizeof(uint64_t) + table->sizes.capacity();
+  }
+
+  this->tables_account_.Set(bytes);
+}
+
+const LZ77::CodeTable &LZ77::Encoder::GetOffsetCodes() const
+{
+  return this->offset_codes_;
+}
+
+const LZ77::CodeTable &LZ77::Encoder::GetLengthCodes() const
+{
+  return this->length_codes_;
+}
+
+uint64_t LZ77::Encoder::TablesSize()
+{
+  // Symbols numbers
+  uint64_t bits = 16 + 16;
+
+  // Tuples (symbol, size, code)
+  for (auto const &p : this->offset_symbol_encode_)
+  {
+    bits += 16 + 8 + p.second.size();
+  }
+
+  for (auto const &p : this->length_symbol_encode_)
+  {
+    bits += 8 + 8 + p.second.size();
+  }
+
+  return bits;
+}
+
+uint64_t LZ77::Encoder::TriplesSize(const CodeTable &offset_codes,
+                                    const CodeTable &length_codes) const
+{
+  uint64_t bits = 0;
+
+  for (size_t i = 0; i < this->tokens_.Size(); i++)
+  {
+    uint16_t offset = this->tokens_.offsets[i];
+    uint16_t length = this->tokens_.lengths[i];
+
+    // A symbol without code can not be sent
+    if (!offset_codes.Has(offset) || !length_codes.Has(length))
+    {
+      return UINT64_MAX;
+    }
+
+    bits += offset_codes.sizes[offset] + length_codes.sizes[length] + 8;
+  }
+
+  return bits;
+}
 
-  int offset_symbol_number = huffman_encoder_offset->GetSymbolTable().size();
+void LZ77::Encoder::WriteTables(Bitstream &bstream)
+{
+  int offset_symbol_number = this->offset_symbol_encode_.size();
 
   // Inserts symbols number as bits
   for (int i = 0; i < 16; i++)
   {
     bstream.writeBit((offset_symbol_number >> (15 - i)) & 1);
-    bstream_vector.push_back((offset_symbol_number >> (15 - i)) & 1);
   }
 
-  std::map<std::string, std::string> offset_symbol_encode =
-      huffman_encoder_offset->GetSymbolEncode();
-
   // Inserts array of tuples as bits
-  for (auto p : offset_symbol_encode)
+  for (auto const &p : this->offset_symbol_encode_)
   {
     // Inserts Symbol
     for (int i = 0; i < 16; i++)
     {
-      bit = p.first[i];
-      bstream.writeBit(stoi(bit));
-      bstream_vector.push_back(stoi(bit));
+      bstream.writeBit(p.first[i] == '1');
     }
 
     // Inserts encode size
     for (uint i = 0; i < 8; i++)
     {
       bstream.writeBit((p.second.size() >> (7 - i)) & 1);
-      bstream_vector.push_back((p.second.size() >> (7 - i)) & 1);
     }
 
     // Inserts symbol encode
     for (uint i = 0; i < p.second.size(); i++)
     {
-      bit = p.second[i];
-      bstream.writeBit(stoi(bit));
-      bstream_vector.push_back(stoi(bit));
+      bstream.writeBit(p.second[i] == '1');
     }
   }
 
-  int length_symbol_number = huffman_encoder_length->GetSymbolTable().size();
+  int length_symbol_number = this->length_symbol_encode_.size();
 
   // Inserts symbols number as bits
   for (int i = 0; i < 16; i++)
   {
     bstream.writeBit((length_symbol_number >> (15 - i)) & 1);
-    bstream_vector.push_back((length_symbol_number >> (15 - i)) & 1);
   }
 
-  std::map<std::string, std::string> length_symbol_encode =
-      huffman_encoder_length->GetSymbolEncode();
-
   // Inserts array of tuples as bits
-  for (auto p : length_symbol_encode)
+  for (auto const &p : this->length_symbol_encode_)
   {
     // Inserts Symbol
     for (int i = 0; i < 8; i++)
     {
-      bit = p.first[8 + i];
-      bstream.writeBit(stoi(bit));
-      bstream_vector.push_back(stoi(bit));
+      bstream.writeBit(p.first[8 + i] == '1');
     }
 
     // Inserts encode size
     for (uint i = 0; i < 8; i++)
     {
       bstream.writeBit((p.second.size() >> (7 - i)) & 1);
-      bstream_vector.push_back((p.second.size() >> (7 - i)) & 1);
     }
 
     // Inserts symbol encode
     for (uint i = 0; i < p.second.size(); i++)
     {
-      bit = p.second[i];
-      bstream.writeBit(stoi(bit));
-      bstream_vector.push_back(stoi(bit));
+      bstream.writeBit(p.second[i] == '1');
     }
   }
+}
+
+const LZ77::TokenBuffer &LZ77::Encoder::GetTokens() const
+{
+  return this->tokens_;
+}
+
+void LZ77::Encoder::WriteTriples(Bitstream &bstream)
+{
+  const CodeTable &offset_codes = this->offset_codes_;
+  const CodeTable &length_codes = this->length_codes_;
 
   // Content write
-  for (auto const &triple : this->triples_vector_)
+  for (size_t j = 0; j < this->tokens_.Size(); j++)
   {
-    std::string offset = LZ77::IntToBinString(triple.offset, 16);
-    std::string offset_code = offset_symbol_encode[offset];
-    std::string length = LZ77::IntToBinString(triple.length, 16);
-    std::string length_code = length_symbol_encode[length];
-    std::string bit = "";
+    uint16_t offset = this->tokens_.offsets[j];
+    uint16_t length = this->tokens_.lengths[j];
+    uint8_t literal = this->tokens_.literals[j];
 
-    // Inserts offset size
-    for (uint i = 0; i < offset_code.size(); i++)
+    if (!offset_codes.Has(offset) || !length_codes.Has(length))
     {
-      bit = offset_code[i];
-      bstream.writeBit(stoi(bit));
-      bstream_vector.push_back((stoi(bit)));
+      throw std::invalid_argument("Symbol without Huffman code");
     }
 
-    // Inserts length
-    for (uint i = 0; i < length_code.size(); i++)
+    int offset_size = offset_codes.sizes[offset];
+    int length_size = length_codes.sizes[length];
+
+    // Inserts offset code
+    for (int i = offset_size - 1; i >= 0; i--)
     {
-      bit = length_code[i];
-      bstream.writeBit(stoi(bit));
-      bstream_vector.push_back(stoi(bit));
+      bstream.writeBit((offset_codes.codes[offset] >> i) & 1);
     }
 
-    char char_codeword[2];
-    std::strcpy(char_codeword, triple.codeword.c_str()); // or pass &s[0]
+    // Inserts length code
+    for (int i = length_size - 1; i >= 0; i--)
+    {
+      bstream.writeBit((length_codes.codes[length] >> i) & 1);
+    }
 
     // Inserts codeword
-    for (uint i = 0; i < 8; i++)
+    for (int i = 0; i < 8; i++)
     {
-      bstream.writeBit((char_codeword[0] >> (7 - i)) & 1);
-      bstream_vector.push_back((char_codeword[0] >> (7 - i)) & 1);
+      bstream.writeBit((literal >> (7 - i)) & 1);
     }
-  }
-#if DEBUG_COMPRESSED_BSTREAM
 
-  for (auto x : bstream_vector)
-  {
-    std::cout << x;
-  }
-
-  std::cout << "\n";
-#endif
+    if (Stats::kEnabled)
+    {
+      Stats::Counters &stats = Stats::Local();
 
-  bstream.flushesToFile(file_path);
+      stats.offset_bits += offset_size;
+      stats.length_bits += length_size;
+      stats.literal_bits += 8;
+    }
+  }
 }
 
 void LZ77::Decoder::DecompressFromFile(std::string file_path)
@@ -613,6 +1050,9 @@ void LZ77::Decoder::DecompressFromFile(std::string file_path)
     this->encoded_content_buffer_.push_back(bit);
   }
 
+  this->DecodeOriginalSize();
+  this->AllocateOutput();
+
 #if DEBUG
   {
     std::cout << "-----------------------------\n"
@@ -627,22 +1067,136 @@ void LZ77::Decoder::DecompressFromFile(std::string file_path)
 #endif
 }
 
-void LZ77::Decoder::Decode(std::string option)
+void LZ77::Decoder::DecompressFromBuffer(const void *source, size_t n)
 {
-  // How many symbols are in the header
-  int n_symbols = 0;
+  // Initialize current decoder reader position
+  this->current_bit_ = 0;
 
-  // Current bit set to read
-  // in the encoded_content_buffer
-  int current_bit = this->current_bit_;
+  // Bitstream object over the buffer bytes
+  Bitstream bstream = Bitstream(static_cast<const uint8_t *>(source), n);
+  bool bit;
 
-  // Symbol read from the header
-  std::string symbol;
+  // Inserts buffer content in decoder buffer
+  while (bstream.hasBits())
+  {
+    bit = bstream.readBit();
+    this->encoded_content_buffer_.push_back(bit);
+  }
 
-  // Size read from header
-  int symbol_size = 0;
+  this->DecodeOriginalSize();
+}
 
-  // Encode read from the header
+void LZ77::Decoder::DecodeOriginalSize()
+{
+  this->original_size_ = 0;
+
+  if (this->encoded_content_buffer_.size() < this->current_bit_ + 64)
+  {
+    throw std::invalid_argument("Truncated .lz77 header");
+  }
+
+  // Converts the 8 bytes binary
+  // original size to a decimal count
+  for (int i = 0; i < 64; i++)
+  {
+    this->original_size_ |=
+        (uint64_t(this->encoded_content_buffer_[this->current_bit_]) << (63 - i));
+    this->current_bit_++;
+  }
+
+  this->dictionary_size_ = 0;
+  this->dictionary_tables_ = false;
+
+  // The dictionary the content was compressed with
+  // is put before it, its matches reference it
+  if (this->original_size_ & kDictionaryFlag)
+  {
+    uint32_t id = 0;
+
+    this->dictionary_tables_ = this->original_size_ & kDictionaryTablesFlag;
+    this->original_size_ &= ~(kDictionaryFlag | kDictionaryTablesFlag);
+
+    if (this->encoded_content_buffer_.size() < this->current_bit_ + 32)
+    {
+      throw std::invalid_argument("Truncated .lz77 header");
+    }
+
+    for (int i = 0; i < 32; i++)
+    {
+      id |= uint32_t(this->encoded_content_buffer_[this->current_bit_]) << (31 - i);
+      this->current_bit_++;
+    }
+
+    if (this->dictionary_.content.empty() || id != this->dictionary_.id)
+    {
+      throw std::invalid_argument("The .lz77 content needs dictionary " +
+                                  std::to_string(id));
+    }
+
+    if (this->dictionary_tables_ && this->dictionary_offset_codes_.empty())
+    {
+      throw std::invalid_argument("The .lz77 content needs the dictionary tables");
+    }
+
+    this->dictionary_size_ = this->dictionary_.content.size();
+  }
+
+  this->output_position_ = this->dictionary_size_;
+}
+
+void LZ77::Decoder::SetOutput(void *destination, size_t capacity)
+{
+  this->output_ = static_cast<uint8_t *>(destination);
+  this->output_capacity_ = capacity;
+}
+
+void LZ77::Decoder::AllocateOutput()
+{
+  // Every triple takes a literal and a code of
+  // 1 bit at least for its offset and its length,
+  // and gives at most a whole look ahead buffer
+  uint64_t max_triples = (this->encoded_content_buffer_.size() - this->current_bit_) / 10;
+
+  if (this->original_size_ > max_triples * (LZ77::kLookAheadBufferSize + 1))
+  {
+    throw std::invalid_argument("Corrupted .lz77 header");
+  }
+
+  // The whole output is allocated once,
+  // matches are copied inside it
+  this->decompressed_content_buffer.resize(this->original_size_ +
+                                           LZ77::kWildCopySlack);
+  this->output_ = this->decompressed_content_buffer.data();
+  this->output_capacity_ = this->decompressed_content_buffer.size();
+}
+
+uint64_t LZ77::Decoder::GetOriginalSize()
+{
+  return this->original_size_;
+}
+
+void LZ77::Decoder::Decode(std::string option)
+{
+  // The tables come with the dictionary, no header is read
+  if (this->dictionary_tables_)
+  {
+    return;
+  }
+
+  // How many symbols are in the header
+  int n_symbols = 0;
+
+  // Current bit set to read
+  // in the encoded_content_buffer
+  uint64_t current_bit = this->current_bit_;
+
+  // Symbol read from the header
+  std::string symbol;
+
+  // Size read from header
+  int symbol_size = 0;
+
+  // Encode read from the header
   std::string encode;
 
   // Encode read from the header
@@ -759,11 +1313,21 @@ void LZ77::Decoder::DecompressLZ77Code()
   // Bit read from the compressed file
   std::string bit = "";
 
-  std::map<std::string, std::string>::iterator it;
+  std::map<std::string, std::string>::const_iterator it;
 
-  int length, offset;
+  int length = 0, offset = 0;
 
-  int current_bit = 0;
+  uint64_t current_bit = 0;
+
+  // Output position past the content, after the dictionary
+  uint64_t const output_end = this->dictionary_size_ + this->original_size_;
+
+  const std::map<std::string, std::string> &offset_code_to_symbol =
+      this->dictionary_tables_ ? this->dictionary_offset_codes_
+                               : this->offset_code_to_symbol_;
+  const std::map<std::string, std::string> &length_code_to_symbol =
+      this->dictionary_tables_ ? this->dictionary_length_codes_
+                               : this->length_code_to_symbol_;
 
   while (this->current_bit_ <
          this->encoded_content_buffer_.size())
@@ -782,8 +1346,8 @@ void LZ77::Decoder::DecompressLZ77Code()
     {
       // Theres a corresponding code read from the
       // compressed file?
-      if ((it = this->offset_code_to_symbol_.find(code)) !=
-          this->offset_code_to_symbol_.end())
+      if ((it = offset_code_to_symbol.find(code)) !=
+          offset_code_to_symbol.end())
       {
         std::string string_offset = it->second;
 #if DEBUG_DECOMPRESS_STREAM
@@ -812,14 +1376,14 @@ void LZ77::Decoder::DecompressLZ77Code()
     {
       // Theres a corresponding code read from the
       // compressed file?
-      if ((it = this->length_code_to_symbol_.find(code)) !=
-          this->length_code_to_symbol_.end())
+      if ((it = length_code_to_symbol.find(code)) !=
+          length_code_to_symbol.end())
       {
         std::string string_length = it->second;
         length = 0;
         current_bit = 0;
 
-        for (int i = 0; i < 8; i++)
+        for (uint64_t i = 0; i < 8; i++)
         {
 
           if (i >= string_length.size())
@@ -845,103 +1409,1623 @@ void LZ77::Decoder::DecompressLZ77Code()
 
     else
     {
+      uint8_t symbol = 0;
 
-      std::string match = "";
-      std::string symbol = "";
-      bool bool_bit;
-      int last_bit = this->decompressed_content_buffer.size() - 1;
-      int replicate_begining = last_bit -
-                               (offset * 8) + 1;
-#if DEBUG_DECOMPRESS_STREAM
+      // The triple must fit in the original size and the
+      // match must start inside the output, before itself
+      if (this->output_position_ + length + 1 > output_end ||
+          (length > 0 && (offset == 0 || (uint64_t)offset > this->output_position_)) ||
+          this->current_bit_ + 8 > this->encoded_content_buffer_.size())
+      {
+        throw std::invalid_argument("Corrupted .lz77 content");
+      }
+
+      uint64_t content_position = this->output_position_ - this->dictionary_size_;
+      uint8_t *output = this->output_ + content_position;
 
+#if DEBUG_DECOMPRESS_STREAM
       std::cout << "Replicate_begining:"
-                << replicate_begining
+                << this->output_position_ - offset
                 << std::endl;
 #endif
-      // Matching writting
-      if (length > 0)
+      // Matching writting, wild copies need slack past the
+      // match and a source inside the output
+      if (length > 0 && (uint64_t)offset <= content_position &&
+          content_position + length + LZ77::kWildCopySlack <= this->output_capacity_)
+      {
+        LZ77::CopyMatch(output, offset, length);
+      }
+
+      // Bytes of the dictionary or near the output end
+      else
       {
-        // Codeword to write
-        for (int i = 0; i < (length * 8); i++)
+        for (int i = 0; i < length; i++)
         {
-          bool_bit = this->decompressed_content_buffer[replicate_begining + i];
-          this->decompressed_content_buffer.push_back(bool_bit);
-          match += std::to_string(bool_bit);
+          uint64_t source = this->output_position_ + i - offset;
+
+          output[i] = source < this->dictionary_size_
+                          ? this->dictionary_.content[source]
+                          : this->output_[source - this->dictionary_size_];
         }
       }
 
       // Codeword to write
       for (int i = 0; i < 8; i++)
       {
-        bit = std::to_string(
-            this->encoded_content_buffer_[this->current_bit_ + i]);
-        this->decompressed_content_buffer.push_back(stoi(bit));
-        symbol += bit;
+        symbol = (symbol << 1) |
+                 this->encoded_content_buffer_[this->current_bit_ + i];
       }
 
+      output[length] = symbol;
+
       this->current_bit_ += 8;
+      this->output_position_ += length + 1;
 
 #if DEBUG_DECOMPRESS_STREAM
       std::cout << "Code:"
-                << symbol
+                << (int)symbol
                 << std::endl;
 #endif
 
-      symbol.clear();
       code.clear();
-      match.clear();
       state = kOffset;
+
+      // Every byte written, padding bits
+      // are left unread
+      if (this->output_position_ == output_end)
+      {
+        break;
+      }
+
       continue;
     }
 
     this->current_bit_++;
   }
+
+  if (this->output_position_ != output_end)
+  {
+    throw std::invalid_argument("Truncated .lz77 content");
+  }
 }
 
-std::string LZ77::IntToBinString(int value, int string_size)
+#if defined(__SSSE3__)
+// Shuffle masks replicating the first offset bytes
+// of a 16 bytes register along the whole register
+alignas(16) static const uint8_t kPatternShuffle[16][16] = {
+  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1},
+  {0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+  {0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0},
+  {0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1},
+  {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 1, 2, 3, 4},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0, 1, 2},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0, 1},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0},
+};
+
+// Largest multiple of the offset that fits in 16 bytes,
+// a replicated register is written every kPatternAdvance bytes
+static const uint8_t kPatternAdvance[16] = {0, 16, 16, 15, 16, 15, 12, 14, 16, 9, 10, 11, 12, 13, 14, 15};
+#endif
+
+void LZ77::CopyMatch(uint8_t *destination, size_t offset, size_t length)
 {
-  std::string bin = "";
-  int offset;
+  // A match never copies itself, the decoders reject it
+  assert(offset != 0 || length == 0);
 
-  for (int i = 0; i < string_size; i++)
+#if defined(__SSSE3__)
+  uint8_t *end = destination + length;
+
+  if (length == 0)
   {
-    offset = string_size - 1 - i;
+    return;
+  }
 
-    bin += std::to_string(((value >> offset) & 1));
+  // Short offset, the pattern is replicated
+  // to a full register once and written
+  // keeping its phase
+  if (offset < 16)
+  {
+    __m128i pattern = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(destination - offset)),
+        _mm_load_si128(reinterpret_cast<const __m128i *>(kPatternShuffle[offset])));
+
+    do
+    {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(destination), pattern);
+      destination += kPatternAdvance[offset];
+    } while (destination < end);
+
+    return;
   }
 
-  return bin;
+  // Wild copy, 16 bytes chunks that never overlap.
+  // The last one may pass the match end
+  do
+  {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(destination),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(destination - offset)));
+    destination += 16;
+  } while (destination < end);
+#else
+  // Overlapping match, the offset bytes before destination
+  // repeat along the match. Copying them doubles the
+  // repeated pattern, so the distance can be doubled
+  // until the copies no longer overlap
+  while (offset < 8 && length > 0)
+  {
+    size_t n = std::min(offset, length);
+
+    std::memcpy(destination, destination - offset, n);
+    destination += n;
+    length -= n;
+    offset *= 2;
+  }
+
+  // 16 bytes copies, source and destination
+  // chunks never overlap
+  if (offset >= 16)
+  {
+    while (length >= 16)
+    {
+      std::memcpy(destination, destination - offset, 16);
+      destination += 16;
+      length -= 16;
+    }
+  }
+
+  // 8 bytes copies
+  while (length >= 8)
+  {
+    std::memcpy(destination, destination - offset, 8);
+    destination += 8;
+    length -= 8;
+  }
+
+  // Remaining bytes, fewer than the offset
+  std::memcpy(destination, destination - offset, length);
+#endif
 }
 
-int LZ77::BinStringToInt(std::string bin_value)
+bool LZ77::StreamDecoder::ReadBit()
 {
-  int value_size = bin_value.size();
-  int int_value = 0;
-  std::string bit;
+  if (this->bit_count_ == 0)
+  {
+    // Input buffer consumed, reads the next chunk
+    if (this->input_position_ == this->input_size_)
+    {
+      this->input_->read(reinterpret_cast<char *>(this->input_buffer_.data()),
+                         this->input_buffer_.size());
+      this->input_size_ = this->input_->gcount();
+      this->input_position_ = 0;
 
-  // Read size
-  for (int i = 0; i < value_size; i++)
+      if (this->input_size_ == 0)
+      {
+        throw std::invalid_argument("Truncated .lz77 content");
+      }
+    }
+
+    this->bit_buffer_ = this->input_buffer_[this->input_position_++];
+    this->bit_count_ = 8;
+    this->bytes_read_++;
+  }
+
+  this->bit_count_--;
+
+  return (this->bit_buffer_ >> this->bit_count_) & 1;
+}
+
+uint64_t LZ77::StreamDecoder::ReadBits(int n_bits)
+{
+  uint64_t value = 0;
+
+  for (int i = 0; i < n_bits; i++)
   {
-    bit = bin_value[i];
-    // Converts the 2 byte binary
-    // symbol size form to a decimal count
-    int_value |= (std::stoi(bit) << ((value_size - 1) - i));
+    value = (value << 1) | this->ReadBit();
   }
 
-  return int_value;
+  return value;
 }
 
-void LZ77::Decoder::DecompressToFile(std::string file_name)
+void LZ77::StreamDecoder::DecodeTable(
+    int n_symbol_bits,
+    std::map<std::pair<int, uint64_t>, int> &code_to_symbol)
 {
+  // How many symbols are in the header
+  int n_symbols = this->ReadBits(16);
 
-  // Empty Bitstream object
-  Bitstream bstream;
+  code_to_symbol.clear();
+
+  // Parses header to an map
+  // of code to original symbol, for each symbol
+  while (n_symbols--)
+  {
+    int symbol = this->ReadBits(n_symbol_bits);
+    int symbol_size = this->ReadBits(8);
+
+    if (symbol_size == 0 || symbol_size > 64)
+    {
+      throw std::invalid_argument("Unsupported .lz77 code size");
+    }
+
+    code_to_symbol[std::make_pair(symbol_size, this->ReadBits(symbol_size))] =
+        symbol;
+  }
+
+  this->tables_account_.Set(
+      (this->offset_code_to_symbol_.size() + this->length_code_to_symbol_.size()) *
+      (kTreeNodeBytes + sizeof(std::pair<const std::pair<int, uint64_t>, int>)));
+}
+
+int LZ77::StreamDecoder::DecodeSymbol(
+    const std::map<std::pair<int, uint64_t>, int> &code_to_symbol)
+{
+  uint64_t code = 0;
+
+  for (int code_size = 1; code_size <= 64; code_size++)
+  {
+    code = (code << 1) | this->ReadBit();
+
+    auto it = code_to_symbol.find(std::make_pair(code_size, code));
+
+    if (it != code_to_symbol.end())
+    {
+      return it->second;
+    }
+  }
+
+  throw std::invalid_argument("Corrupted .lz77 content");
+}
+
+void LZ77::StreamDecoder::SlideWindow(std::ostream &output)
+{
+  Stats::ScopedTimer timer(Stats::kOutput);
+
+  // Bytes matches may still reference
+  size_t keep = std::min<size_t>(this->window_position_, LZ77::kMaxOffset);
+
+  this->FlushWindow(output);
+  this->HashWindow();
+
+  std::memmove(this->window_.data(),
+               this->window_.data() + this->window_position_ - keep,
+               keep);
+
+  this->window_raw_offset_ += this->window_position_ - keep;
+  this->window_position_ = keep;
+  this->flushed_position_ = keep;
+  this->hashed_position_ = keep;
+}
+
+void LZ77::StreamDecoder::HashWindow()
+{
+  Stats::ScopedTimer timer(Stats::kChecksum);
+  Trace::Span span("checksum");
+
+  this->block_state_.Update(this->window_.data() + this->hashed_position_,
+                            this->window_position_ - this->hashed_position_);
+  this->hashed_position_ = this->window_position_;
+}
+
+void LZ77::StreamDecoder::FlushWindow(std::ostream &output)
+{
+  Stats::ScopedTimer timer(Stats::kOutput);
+  Trace::Span span("output");
+
+  // Original content positions of the bytes to flush
+  uint64_t begin = this->window_raw_offset_ + this->flushed_position_;
+  uint64_t end = this->window_raw_offset_ + this->window_position_;
+
+  begin = std::max(begin, this->range_begin_);
+  end = std::min(end, this->range_end_);
+
+  if (begin < end)
+  {
+    output.write(reinterpret_cast<const char *>(
+                     this->window_.data() + (begin - this->window_raw_offset_)),
+                 end - begin);
+  }
+
+  this->flushed_position_ = this->window_position_;
+}
+
+void LZ77::StreamDecoder::ReadBytes(uint8_t *bytes, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    bytes[i] = this->ReadBits(8);
+  }
+}
+
+void LZ77::StreamDecoder::Initialize(std::istream &input, uint64_t raw_offset)
+{
+  this->input_ = &input;
+  this->input_buffer_.resize(kFlushSize);
+  this->input_position_ = 0;
+  this->input_size_ = 0;
+  this->bit_count_ = 0;
+  this->bytes_read_ = 0;
+  this->decoded_size_ = raw_offset;
+  this->restart_raw_offset_ = raw_offset;
+  this->has_tables_ = false;
+  this->frame_flags_ = 0;
+  this->dictionary_size_ = 0;
+  this->block_checksums_.clear();
+
+  // Kept bytes, a chunk to be flushed and
+  // room for a whole triple and its wild copy
+  this->window_.resize(LZ77::kMaxOffset + kFlushSize + 256 +
+                       LZ77::kWildCopySlack);
+  this->window_position_ = 0;
+  this->flushed_position_ = 0;
+  this->hashed_position_ = 0;
+  this->window_raw_offset_ = raw_offset;
+
+  // Whole content written by default
+  this->range_begin_ = 0;
+  this->range_end_ = UINT64_MAX;
+}
+
+void LZ77::StreamDecoder::DecompressStream(std::istream &input,
+                                           std::ostream &output)
+{
+  uint8_t header_bytes[Frame::kFrameHeaderSize];
+
+  this->Initialize(input, 0);
 
-  for (auto bit : this->decompressed_content_buffer)
+  // Rejects foreign files before decoding anything
+  this->ReadBytes(header_bytes, Frame::kFrameHeaderSize);
+  Frame::FrameHeader frame_header = Frame::ParseFrameHeader(header_bytes);
+
+  if (frame_header.flags & Frame::kDictionary)
+  {
+    this->ReadBytes(header_bytes, Frame::kDictionaryIdSize);
+    frame_header.dictionary_id = Frame::ParseDictionaryId(header_bytes);
+  }
+
+  this->block_size_ = frame_header.block_size;
+  this->frame_flags_ = frame_header.flags;
+  this->UseDictionary(frame_header);
+
+  uint64_t n_restarts = this->DecompressBlocks(UINT64_MAX, output);
+
+  // Flushes the remaining bytes
+  this->FlushWindow(output);
+
+  if (frame_header.flags & Frame::kContentChecksum)
+  {
+    uint8_t checksum_bytes[Frame::kChecksumSize];
+
+    this->ReadBytes(checksum_bytes, Frame::kChecksumSize);
+
+    if (Frame::ReadUint(checksum_bytes, Frame::kChecksumSize) !=
+        Frame::FrameChecksum(this->block_checksums_))
+    {
+      throw std::invalid_argument("The .lz77 frame checksum does not match");
+    }
+  }
+
+  // Consumes the block index, one entry per restart block
+  if (frame_header.flags & Frame::kBlockIndex)
+  {
+    std::vector<uint8_t> index_bytes(n_restarts * Frame::kIndexEntrySize +
+                                     Frame::kIndexTrailerSize);
+
+    this->ReadBytes(index_bytes.data(), index_bytes.size());
+
+    if (Frame::ReadUint(index_bytes.data() + index_bytes.size() -
+                            Frame::kIndexTrailerSize,
+                        4) != n_restarts)
+    {
+      throw std::invalid_argument("Corrupted .lz77 block index");
+    }
+  }
+}
+
+std::vector<Frame::IndexEntry> LZ77::StreamDecoder::ReadIndex(
+    std::istream &input, Frame::FrameHeader &frame_header)
+{
+  uint8_t header_bytes[Frame::kFrameHeaderSize];
+  uint8_t trailer_bytes[Frame::kIndexTrailerSize];
+
+  input.seekg(0, std::ios::beg);
+  input.read(reinterpret_cast<char *>(header_bytes), Frame::kFrameHeaderSize);
+
+  if (input.gcount() != Frame::kFrameHeaderSize)
+  {
+    throw std::invalid_argument("The input is not a .lz77 file");
+  }
+
+  frame_header = Frame::ParseFrameHeader(header_bytes);
+
+  if (frame_header.flags & Frame::kDictionary)
+  {
+    input.read(reinterpret_cast<char *>(header_bytes), Frame::kDictionaryIdSize);
+
+    if (input.gcount() != Frame::kDictionaryIdSize)
+    {
+      throw std::invalid_argument("The input is not a .lz77 file");
+    }
+
+    frame_header.dictionary_id = Frame::ParseDictionaryId(header_bytes);
+  }
+
+  if (!(frame_header.flags & Frame::kBlockIndex))
+  {
+    throw std::invalid_argument("The .lz77 file has no block index");
+  }
+
+  // The index trailer holds the entries
+  // number and the whole index size
+  input.seekg(-(std::streamoff)Frame::kIndexTrailerSize, std::ios::end);
+  input.read(reinterpret_cast<char *>(trailer_bytes), Frame::kIndexTrailerSize);
+
+  uint64_t n_entries = Frame::ReadUint(trailer_bytes, 4);
+  uint64_t index_size = Frame::ReadUint(trailer_bytes + 4, 4);
+
+  if (!input || index_size != n_entries * Frame::kIndexEntrySize +
+                                  Frame::kIndexTrailerSize)
+  {
+    throw std::invalid_argument("Corrupted .lz77 block index");
+  }
+
+  std::vector<uint8_t> index_bytes(n_entries * Frame::kIndexEntrySize);
+
+  input.seekg(-(std::streamoff)index_size, std::ios::end);
+  input.read(reinterpret_cast<char *>(index_bytes.data()), index_bytes.size());
+
+  if (!input)
+  {
+    throw std::invalid_argument("Corrupted .lz77 block index");
+  }
+
+  input.clear();
+
+  return Frame::ParseIndex(index_bytes.data(), n_entries);
+}
+
+void LZ77::StreamDecoder::DecompressRange(std::istream &input, uint64_t offset,
+                                          uint64_t length, std::ostream &output)
+{
+  Frame::FrameHeader frame_header;
+  std::vector<Frame::IndexEntry> index =
+      LZ77::StreamDecoder::ReadIndex(input, frame_header);
+
+  // Last restart point before offset
+  auto restart = std::upper_bound(
+      index.begin(), index.end(), offset,
+      [](uint64_t value, const Frame::IndexEntry &entry)
+      { return value < entry.raw_offset; });
+
+  if (length == 0 || restart == index.begin())
   {
-    bstream.writeBit(bit);
+    return;
   }
 
-  //Grava o bitstream no arquivo.
-  bstream.flushesToDecompressedFile(file_name);
+  restart--;
+
+  input.seekg(restart->compressed_offset, std::ios::beg);
+
+  this->Initialize(input, restart->raw_offset);
+  this->block_size_ = frame_header.block_size;
+  this->frame_flags_ = frame_header.flags;
+  this->UseDictionary(frame_header);
+  this->range_begin_ = offset;
+  this->range_end_ = (UINT64_MAX - offset < length) ? UINT64_MAX : offset + length;
+
+  this->DecompressBlocks(this->range_end_, output);
+  this->FlushWindow(output);
+}
+
+std::vector<uint64_t> LZ77::StreamDecoder::VerifySegment(
+    std::istream &input, const Frame::FrameHeader &frame_header,
+    const Frame::IndexEntry &restart, uint64_t raw_end)
+{
+  std::ostream null_output(nullptr);
+
+  // The input may be at its end after a previous segment
+  input.clear();
+  input.seekg(restart.compressed_offset, std::ios::beg);
+
+  this->Initialize(input, restart.raw_offset);
+  this->block_size_ = frame_header.block_size;
+  this->frame_flags_ = frame_header.flags;
+  this->UseDictionary(frame_header);
+  this->range_end_ = 0;
+
+  this->DecompressBlocks(raw_end, null_output);
+
+  // Segments end where the next one begins
+  if (raw_end != UINT64_MAX && this->decoded_size_ != raw_end)
+  {
+    throw std::invalid_argument("Corrupted .lz77 block index");
+  }
+
+  return this->block_checksums_;
+}
+
+uint64_t LZ77::StreamDecoder::DecompressBlocks(uint64_t raw_end,
+                                               std::ostream &output)
+{
+  uint8_t header_bytes[Frame::kBlockHeaderSize + Frame::kChecksumSize];
+  size_t header_size = Frame::BlockHeaderSize(this->frame_flags_);
+  uint64_t n_restarts = 0;
+  bool first_block = true;
+
+  while (this->decoded_size_ < raw_end)
+  {
+    this->ReadBytes(header_bytes, Frame::kEndMarkSize);
+
+    // Frame end
+    if (Frame::ReadUint(header_bytes, Frame::kEndMarkSize) == 0)
+    {
+      break;
+    }
+
+    this->ReadBytes(header_bytes + Frame::kEndMarkSize,
+                    header_size - Frame::kEndMarkSize);
+    Frame::BlockHeader block_header =
+        Frame::ParseBlockHeader(header_bytes, this->frame_flags_);
+
+    if (block_header.raw_size > this->block_size_)
+    {
+      throw std::invalid_argument("Corrupted .lz77 block header");
+    }
+
+    // Decoding starts at a restart point, that references
+    // neither previous content nor tables
+    if (block_header.flags & Frame::kRestart)
+    {
+      if (block_header.flags & Frame::kReuseTables)
+      {
+        throw std::invalid_argument("Corrupted .lz77 block header");
+      }
+
+      this->restart_raw_offset_ = this->decoded_size_;
+      this->PreloadDictionary(output);
+      n_restarts++;
+    }
+
+    else if (first_block)
+    {
+      throw std::invalid_argument("The .lz77 block is not a restart point");
+    }
+
+    first_block = false;
+
+    uint64_t payload_start = this->bytes_read_;
+
+    this->block_state_.Reset();
+    this->hashed_position_ = this->window_position_;
+
+    this->DecompressBlock(block_header.raw_size, block_header.flags, output);
+
+    if (this->frame_flags_ & Frame::kContentChecksum)
+    {
+      this->HashWindow();
+
+      if (this->block_state_.Digest() != block_header.checksum)
+      {
+        throw std::invalid_argument("The .lz77 block checksum does not match");
+      }
+
+      this->block_checksums_.push_back(block_header.checksum);
+    }
+
+    // Skips the last byte padding bits
+    // and any byte left in the payload
+    this->bit_count_ = 0;
+
+    while (this->bytes_read_ - payload_start < block_header.compressed_size)
+    {
+      this->ReadBits(8);
+    }
+
+    if (this->bytes_read_ - payload_start > block_header.compressed_size)
+    {
+      throw std::invalid_argument("Corrupted .lz77 content");
+    }
+  }
+
+  return n_restarts;
+}
+
+void LZ77::StreamDecoder::DecompressBlock(uint64_t raw_size, uint8_t flags,
+                                          std::ostream &output)
+{
+  Stats::ScopedTimer timer(Stats::kDecode);
+  Trace::Span span("decode block");
+  uint64_t block_begin = this->decoded_size_;
+  uint64_t n_triples = 0;
+
+  span.Arg("raw_offset", block_begin);
+  span.Arg("size", raw_size);
+
+  // Bitstream header, the last byte valid bits
+  // are not needed as the raw size is known
+  if ((this->ReadBits(8) & 0xF0) != 0xE0)
+  {
+    throw std::invalid_argument("Corrupted .lz77 block");
+  }
+
+  uint64_t block_end = this->decoded_size_ + raw_size;
+
+  if (flags & Frame::kReuseTables)
+  {
+    if (!this->has_tables_)
+    {
+      throw std::invalid_argument("Corrupted .lz77 block, no tables to reuse");
+    }
+  }
+
+  else
+  {
+    this->DecodeTable(16, this->offset_code_to_symbol_);
+    this->DecodeTable(8, this->length_code_to_symbol_);
+    this->has_tables_ = true;
+  }
+
+  while (this->decoded_size_ < block_end)
+  {
+    uint64_t offset = this->DecodeSymbol(this->offset_code_to_symbol_);
+    uint64_t length = this->DecodeSymbol(this->length_code_to_symbol_);
+    uint8_t symbol = this->ReadBits(8);
+
+    // The triple must fit in the block and the match must
+    // start before itself, after the last restart point
+    if (this->decoded_size_ + length + 1 > block_end ||
+        (length > 0 &&
+         (offset == 0 ||
+          offset > this->decoded_size_ - this->restart_raw_offset_ +
+                       this->dictionary_size_ ||
+          offset > LZ77::kMaxOffset)))
+    {
+      throw std::invalid_argument("Corrupted .lz77 content");
+    }
+
+    if (this->window_position_ + length + 1 + LZ77::kWildCopySlack >
+        this->window_.size())
+    {
+      this->SlideWindow(output);
+    }
+
+    uint8_t *window = this->window_.data() + this->window_position_;
+
+    if (length > 0)
+    {
+      LZ77::CopyMatch(window, offset, length);
+    }
+
+    window[length] = symbol;
+
+    this->window_position_ += length + 1;
+    this->decoded_size_ += length + 1;
+    n_triples++;
+  }
+
+  if (Stats::kEnabled)
+  {
+    Stats::Counters &stats = Stats::Local();
+
+    stats.decoded_blocks++;
+    stats.decoded_bytes += this->decoded_size_ - block_begin;
+    stats.decoded_triples += n_triples;
+    stats.copied_bytes += this->decoded_size_ - block_begin - n_triples;
+  }
+}
+
+void LZ77::StreamDecoder::SetDictionary(const Dictionary::Preset &dictionary)
+{
+  this->dictionary_ = dictionary;
+}
+
+void LZ77::StreamDecoder::UseDictionary(const Frame::FrameHeader &frame_header)
+{
+  this->dictionary_size_ = 0;
+
+  if (!(frame_header.flags & Frame::kDictionary))
+  {
+    return;
+  }
+
+  if (this->dictionary_.content.empty() ||
+      frame_header.dictionary_id != this->dictionary_.id)
+  {
+    throw std::invalid_argument("The .lz77 content needs dictionary " +
+                                std::to_string(frame_header.dictionary_id));
+  }
+
+  this->dictionary_size_ =
+      std::min<uint64_t>(this->dictionary_.content.size(), LZ77::kMaxOffset);
+}
+
+void LZ77::StreamDecoder::PreloadDictionary(std::ostream &output)
+{
+  if (this->dictionary_size_ == 0)
+  {
+    return;
+  }
+
+  this->FlushWindow(output);
+
+  // The dictionary takes the raw positions before the
+  // block, already flushed, so it is never written.
+  // They wrap around below 0 for the first block.
+  std::memcpy(this->window_.data(),
+              this->dictionary_.content.data() +
+                  this->dictionary_.content.size() - this->dictionary_size_,
+              this->dictionary_size_);
+
+  this->window_raw_offset_ = this->decoded_size_ - this->dictionary_size_;
+  this->window_position_ = this->dictionary_size_;
+  this->flushed_position_ = this->dictionary_size_;
+  this->hashed_position_ = this->dictionary_size_;
+}
+
+LZ77::StreamEncoder::StreamEncoder(size_t block_size)
+    : block_size_(block_size),
+      block_index_(false),
+      restart_interval_(0),
+      checksum_(true),
+      pipeline_(false),
+      in_flight_(0)
+{
+}
+
+LZ77::StreamEncoder::~StreamEncoder()
+{
+  this->Drain(nullptr);
+}
+
+void LZ77::StreamEncoder::SetPipeline(bool pipeline)
+{
+  this->pipeline_ = pipeline;
+}
+
+void LZ77::StreamEncoder::SetChecksum(bool checksum)
+{
+  this->checksum_ = checksum;
+}
+
+void LZ77::StreamEncoder::SetRestartInterval(uint64_t interval)
+{
+  this->restart_interval_ = interval;
+}
+
+void LZ77::StreamEncoder::SetBlockIndex(bool block_index)
+{
+  this->block_index_ = block_index;
+}
+
+void LZ77::StreamEncoder::SetDictionary(const Dictionary::Preset &dictionary)
+{
+  this->dictionary_ = dictionary;
+}
+
+std::vector<uint8_t> LZ77::StreamEncoder::Begin()
+{
+  std::vector<uint8_t> output;
+  Frame::FrameHeader frame_header;
+
+  // Blocks of a stream left unfinished are dropped
+  this->Drain(nullptr);
+
+  this->history_.clear();
+  this->block_.clear();
+  this->index_.clear();
+  this->block_checksums_.clear();
+  this->has_tables_ = false;
+
+  frame_header.version = Frame::kVersion;
+  frame_header.flags = this->block_index_ ? Frame::kBlockIndex : 0;
+
+  if (this->checksum_)
+  {
+    frame_header.flags |= Frame::kContentChecksum;
+  }
+
+  if (!this->dictionary_.content.empty())
+  {
+    frame_header.flags |= Frame::kDictionary;
+    frame_header.dictionary_id = this->dictionary_.id;
+  }
+
+  frame_header.block_size = this->block_size_;
+  Frame::WriteFrameHeader(frame_header, output);
+
+  this->raw_offset_ = 0;
+  this->parsed_offset_ = 0;
+  this->compressed_offset_ = output.size();
+  this->header_size_ = output.size();
+
+  return output;
+}
+
+std::vector<uint8_t> LZ77::StreamEncoder::Update(const void *chunk, size_t n)
+{
+  std::vector<uint8_t> output;
+
+  this->block_.append(static_cast<const char *>(chunk), n);
+
+  // Compresses every complete block
+  size_t position = 0;
+
+  while (this->block_.size() - position >= this->block_size_)
+  {
+    this->CompressBlock(this->block_.data() + position,
+                        this->block_size_, output);
+    position += this->block_size_;
+  }
+
+  this->block_.erase(0, position);
+  this->buffers_account_.Set(this->history_.capacity() + this->block_.capacity());
+
+  return output;
+}
+
+std::vector<uint8_t> LZ77::StreamEncoder::End()
+{
+  std::vector<uint8_t> output = this->Flush();
+
+  Frame::WriteEndMark(output);
+
+  if (this->checksum_)
+  {
+    Frame::WriteUint(Frame::FrameChecksum(this->block_checksums_),
+                     Frame::kChecksumSize, output);
+  }
+
+  if (this->block_index_)
+  {
+    Frame::WriteIndex(this->index_, output);
+  }
+
+  return output;
+}
+
+std::vector<uint8_t> LZ77::StreamEncoder::Flush()
+{
+  std::vector<uint8_t> output;
+
+  if (!this->block_.empty())
+  {
+    this->CompressBlock(this->block_.data(), this->block_.size(), output);
+    this->block_.clear();
+    this->buffers_account_.Set(this->history_.capacity() + this->block_.capacity());
+  }
+
+  this->Drain(&output);
+
+  return output;
+}
+
+LZ77::StreamEncoder::Segment LZ77::StreamEncoder::TakeSegment()
+{
+  Segment segment;
+
+  // The offsets count from the frame header, not written
+  for (auto entry : this->index_)
+  {
+    entry.compressed_offset -= this->header_size_;
+    segment.index.push_back(entry);
+  }
+
+  segment.block_checksums = std::move(this->block_checksums_);
+  segment.raw_size = this->raw_offset_;
+  segment.compressed_size = this->compressed_offset_ - this->header_size_;
+  segment.restart_raw_offset = this->restart_raw_offset_;
+
+  this->index_.clear();
+  this->block_checksums_.clear();
+
+  return segment;
+}
+
+void LZ77::StreamEncoder::AppendSegment(const Segment &segment)
+{
+  for (auto entry : segment.index)
+  {
+    entry.raw_offset += this->raw_offset_;
+    entry.compressed_offset += this->compressed_offset_;
+    this->index_.push_back(entry);
+  }
+
+  this->block_checksums_.insert(this->block_checksums_.end(),
+                                segment.block_checksums.begin(),
+                                segment.block_checksums.end());
+
+  this->restart_raw_offset_ = this->raw_offset_ + segment.restart_raw_offset;
+  this->raw_offset_ += segment.raw_size;
+  this->parsed_offset_ = this->raw_offset_;
+  this->compressed_offset_ += segment.compressed_size;
+
+  // Neither the segment content nor its tables are known here
+  this->history_.clear();
+  this->has_tables_ = false;
+}
+
+void LZ77::StreamEncoder::Trim()
+{
+  this->free_encoders_.clear();
+}
+
+void LZ77::StreamEncoder::CompressBlock(const char *source, size_t n,
+                                        std::vector<uint8_t> &output)
+{
+  ParsedBlock block = this->ParseBlock(source, n);
+
+  if (!this->pipeline_)
+  {
+    this->WriteBlock(block, output);
+    this->free_encoders_.push_back(std::move(block.encoder));
+    return;
+  }
+
+  if (!this->writer_.joinable())
+  {
+    this->parsed_.reset(new ThreadPool::SpscQueue<ParsedBlock>(kPipelineDepth));
+    this->written_.reset(new ThreadPool::SpscQueue<ParsedBlock>(kPipelineDepth));
+    this->writer_ = std::thread(&StreamEncoder::WriterLoop, this);
+  }
+
+  // Waits for the oldest block when the pipeline is full,
+  // so the writer never waits for room in written_
+  while (this->in_flight_ >= kPipelineDepth)
+  {
+    ParsedBlock written = this->written_->Pop();
+
+    this->CollectBlock(written, output);
+  }
+
+  this->parsed_->Push(std::move(block));
+  this->in_flight_++;
+
+  ParsedBlock written;
+
+  while (this->written_->TryPop(written))
+  {
+    this->CollectBlock(written, output);
+  }
+}
+
+LZ77::StreamEncoder::ParsedBlock LZ77::StreamEncoder::ParseBlock(const char *source,
+                                                                 size_t n)
+{
+  ParsedBlock block;
+
+  block.raw_size = n;
+
+  // Restart point, forgets the previous blocks
+  // content and tables, only the dictionary
+  // bytes a match reaches stay before it
+  if (this->parsed_offset_ == 0 ||
+      (this->restart_interval_ > 0 &&
+       this->parsed_offset_ - this->restart_raw_offset_ >= this->restart_interval_))
+  {
+    const std::string &dictionary = this->dictionary_.content;
+
+    block.flags |= Frame::kRestart;
+    this->history_.assign(dictionary, dictionary.size() -
+                                          std::min<size_t>(dictionary.size(),
+                                                           LZ77::kMaxOffset));
+    this->restart_raw_offset_ = this->parsed_offset_;
+  }
+
+  if (this->free_encoders_.empty())
+  {
+    block.encoder.reset(new LZ77::Encoder());
+  }
+
+  else
+  {
+    block.encoder = std::move(this->free_encoders_.back());
+    this->free_encoders_.pop_back();
+    block.encoder->Reset();
+  }
+
+  Stats::ScopedTimer timer(Stats::kParse);
+  Trace::Span span("parse");
+
+  span.Arg("raw_offset", this->parsed_offset_);
+  span.Arg("size", n);
+
+  block.encoder->FillBuffer(this->history_.data(), this->history_.size(),
+                            source, n);
+  block.encoder->Encode();
+
+  // Keeps the last bytes the next
+  // block matches may reference
+  this->history_.append(source, n);
+
+  if (this->history_.size() > LZ77::kMaxOffset)
+  {
+    this->history_.erase(0, this->history_.size() - LZ77::kMaxOffset);
+  }
+
+  this->parsed_offset_ += n;
+
+  return block;
+}
+
+void LZ77::StreamEncoder::WriteBlock(ParsedBlock &block,
+                                     std::vector<uint8_t> &output)
+{
+  LZ77::Encoder &lz77_encoder = *block.encoder;
+  Bitstream bstream;
+  Frame::BlockHeader block_header;
+  std::string_view raw = lz77_encoder.GetBlock();
+
+  block_header.flags = block.flags;
+
+  if (block_header.flags & Frame::kRestart)
+  {
+    this->has_tables_ = false;
+  }
+
+  Stats::ScopedTimer timer(Stats::kTables);
+  Trace::Span block_span("block");
+  Trace::Span stage_span("tables");
+
+  block_span.Arg("raw_offset", this->raw_offset_);
+  block_span.Arg("size", block.raw_size);
+
+  lz77_encoder.ComputeTables();
+
+  // Reuses the previous tables when sending
+  // the triples with them costs less than
+  // sending new tables
+  if (this->has_tables_)
+  {
+    uint64_t new_tables_size =
+        lz77_encoder.TablesSize() +
+        lz77_encoder.TriplesSize(lz77_encoder.GetOffsetCodes(),
+                                 lz77_encoder.GetLengthCodes());
+    uint64_t reused_tables_size =
+        lz77_encoder.TriplesSize(this->offset_codes_, this->length_codes_);
+
+    if (reused_tables_size <= new_tables_size)
+    {
+      lz77_encoder.SetTables(this->offset_codes_, this->length_codes_);
+      block_header.flags |= Frame::kReuseTables;
+    }
+  }
+
+  timer.Switch(Stats::kWrite);
+  stage_span.Switch("write");
+
+  if (!(block_header.flags & Frame::kReuseTables))
+  {
+    lz77_encoder.WriteTables(bstream);
+    this->offset_codes_ = lz77_encoder.GetOffsetCodes();
+    this->length_codes_ = lz77_encoder.GetLengthCodes();
+    this->has_tables_ = true;
+  }
+
+  // Triples streams bits before the block ones
+  uint64_t triples_bits = 0;
+
+  if (Stats::kEnabled)
+  {
+    Stats::Counters &stats = Stats::Local();
+
+    triples_bits = stats.offset_bits + stats.length_bits + stats.literal_bits;
+  }
+
+  lz77_encoder.WriteTriples(bstream);
+
+  block_header.raw_size = raw.size();
+  block_header.compressed_size = bstream.flushedSize();
+  block_header.checksum = 0;
+
+  if (this->checksum_)
+  {
+    Stats::ScopedTimer checksum_timer(Stats::kChecksum);
+    Trace::Span checksum_span("checksum");
+
+    block_header.checksum = Checksum::XXH64(raw.data(), raw.size());
+    this->block_checksums_.push_back(block_header.checksum);
+  }
+
+  uint8_t frame_flags = this->checksum_ ? Frame::kContentChecksum : 0;
+
+  if (block_header.flags & Frame::kRestart)
+  {
+    this->index_.push_back({this->raw_offset_, this->compressed_offset_});
+  }
+
+  size_t block_begin = output.size();
+
+  Frame::WriteBlockHeader(block_header, frame_flags, output);
+  output.resize(output.size() + block_header.compressed_size);
+  bstream.flushesToBuffer(output.data() + block_begin +
+                              Frame::BlockHeaderSize(frame_flags),
+                          block_header.compressed_size);
+
+  this->raw_offset_ += raw.size();
+  this->compressed_offset_ += output.size() - block_begin;
+
+  // Bits of the block outside the triples streams,
+  // its header, tables and last byte padding
+  if (Stats::kEnabled)
+  {
+    Stats::Counters &stats = Stats::Local();
+
+    stats.encoded_blocks++;
+    stats.encoded_bytes += raw.size();
+    stats.reused_tables += (block_header.flags & Frame::kReuseTables) != 0;
+    stats.header_bits += (output.size() - block_begin) * 8 -
+                         (stats.offset_bits + stats.length_bits +
+                          stats.literal_bits - triples_bits);
+  }
+}
+
+void LZ77::StreamEncoder::CollectBlock(ParsedBlock &block,
+                                       std::vector<uint8_t> &output)
+{
+  this->in_flight_--;
+  this->free_encoders_.push_back(std::move(block.encoder));
+
+  if (block.error)
+  {
+    std::rethrow_exception(block.error);
+  }
+
+  output.insert(output.end(), block.output.begin(), block.output.end());
+}
+
+void LZ77::StreamEncoder::Drain(std::vector<uint8_t> *output)
+{
+  if (!this->writer_.joinable())
+  {
+    return;
+  }
+
+  // Joined before rethrowing a block error, so the
+  // stream can be begun again or destroyed
+  std::exception_ptr error;
+
+  while (this->in_flight_ > 0)
+  {
+    ParsedBlock block = this->written_->Pop();
+
+    try
+    {
+      std::vector<uint8_t> dropped;
+
+      this->CollectBlock(block, output != nullptr ? *output : dropped);
+    }
+
+    catch (...)
+    {
+      if (!error)
+      {
+        error = std::current_exception();
+      }
+    }
+  }
+
+  ParsedBlock stop;
+
+  stop.stop = true;
+  this->parsed_->Push(std::move(stop));
+  this->writer_.join();
+
+  if (error && output != nullptr)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+void LZ77::StreamEncoder::WriterLoop()
+{
+  Trace::SetThreadName("writer");
+
+  while (true)
+  {
+    ParsedBlock block = this->parsed_->Pop();
+
+    if (block.stop)
+    {
+      break;
+    }
+
+    try
+    {
+      this->WriteBlock(block, block.output);
+    }
+
+    catch (...)
+    {
+      block.error = std::current_exception();
+    }
+
+    this->written_->Push(std::move(block));
+  }
+}
+
+std::string LZ77::IntToBinString(int value, int string_size)
+{
+  std::string bin = "";
+  int offset;
+
+  for (int i = 0; i < string_size; i++)
+  {
+    offset = string_size - 1 - i;
+
+    bin += std::to_string(((value >> offset) & 1));
+  }
+
+  return bin;
+}
+
+int LZ77::BinStringToInt(std::string bin_value)
+{
+  int value_size = bin_value.size();
+  int int_value = 0;
+  std::string bit;
+
+  // Read size
+  for (int i = 0; i < value_size; i++)
+  {
+    bit = bin_value[i];
+    // Converts the 2 byte binary
+    // symbol size form to a decimal count
+    int_value |= (std::stoi(bit) << ((value_size - 1) - i));
+  }
+
+  return int_value;
+}
+
+void LZ77::Decoder::DecompressToFile(std::string file_name)
+{
+  std::ofstream file(file_name,
+                     std::ios::out | std::ios::binary | std::ios::trunc);
+
+  if (!file)
+  {
+    std::cout << "Could not open " << file_name << "\n";
+    return;
+  }
+
+  file.write(reinterpret_cast<const char *>(this->output_),
+             this->output_position_ - this->dictionary_size_);
+}
+
+void LZ77::Decoder::Reset()
+{
+  this->current_bit_ = 0;
+  this->encoded_content_buffer_.clear();
+  this->original_size_ = 0;
+  this->dictionary_size_ = 0;
+  this->dictionary_tables_ = false;
+  this->output_position_ = 0;
+  this->output_ = nullptr;
+  this->output_capacity_ = 0;
+  this->offset_code_to_symbol_.clear();
+  this->length_code_to_symbol_.clear();
+}
+
+size_t LZ77::Decoder::DecompressToBuffer(void *destination, size_t capacity)
+{
+  size_t n = this->output_position_ - this->dictionary_size_;
+
+  if (n > capacity)
+  {
+    return 0;
+  }
+
+  // Decoded there already with SetOutput
+  if (this->output_ != destination)
+  {
+    std::memcpy(destination, this->output_, n);
+  }
+
+  return n;
+}
+
+void LZ77::Decoder::SetDictionary(const Dictionary::Preset &dictionary)
+{
+  this->dictionary_ = dictionary;
+  this->dictionary_offset_codes_.clear();
+  this->dictionary_length_codes_.clear();
+
+  // Inverted once, as the headers are read: the
+  // length symbols are kept as their 8 low bits
+  for (const auto &p : dictionary.offset_table)
+  {
+    this->dictionary_offset_codes_[p.second] = p.first;
+  }
+
+  for (const auto &p : dictionary.length_table)
+  {
+    this->dictionary_length_codes_[p.second] = p.first.substr(8);
+  }
+}
+
+size_t LZ77::CompressBound(size_t n)
+{
+  // Triples sent, each one holds at least one byte
+  uint64_t n_triples = n;
+
+  // Distinct offset and length symbols
+  uint64_t n_offsets = std::min<uint64_t>(n_triples, kMaxOffset + 1);
+  uint64_t n_lengths = std::min<uint64_t>(n_triples, 256);
+
+  // A Huffman code of size d needs at least Fibonacci(d + 2)
+  // counted symbols, which bounds the codes sizes
+  uint64_t code_size = 1;
+  uint64_t fibonacci_previous = 2, fibonacci = 3;
+
+  while (fibonacci <= n_triples && code_size < 255)
+  {
+    std::tie(fibonacci_previous, fibonacci) =
+        std::make_tuple(fibonacci, fibonacci + fibonacci_previous);
+    code_size++;
+  }
+
+  // Huffman codes cost at most as a fixed size code, so
+  // each triple spends at most 16 bits of offset, 8 bits
+  // of length and 8 bits of codeword
+  uint64_t bits = 8 + 64 + 32;
+  bits += 16 + n_offsets * (16 + 8 + code_size);
+  bits += 16 + n_lengths * (8 + 8 + code_size);
+  bits += n_triples * (16 + 8 + 8);
+
+  return bits / 8 + 1;
+}
+
+LZ77::EncoderContext::EncoderContext()
+    : bstream_(new Bitstream())
+{
+}
+
+LZ77::EncoderContext::~EncoderContext()
+{
+}
+
+void LZ77::EncoderContext::Reset()
+{
+  this->encoder_.Reset();
+  this->bstream_->reset();
+}
+
+size_t LZ77::EncoderContext::Compress(const void *source, size_t n,
+                                      void *destination, size_t capacity)
+{
+  this->Reset();
+
+  this->encoder_.FillBuffer(source, n);
+  this->encoder_.Encode();
+  this->encoder_.CompressToBitstream(*this->bstream_);
+
+  return this->bstream_->flushesToBuffer(static_cast<uint8_t *>(destination),
+                                         capacity);
+}
+
+void LZ77::EncoderContext::SetDictionary(const Dictionary::Preset &dictionary)
+{
+  this->encoder_.SetDictionary(dictionary);
+}
+
+void LZ77::DecoderContext::Reset()
+{
+  this->decoder_.Reset();
+}
+
+size_t LZ77::DecoderContext::Decompress(const void *source, size_t n,
+                                        void *destination, size_t capacity)
+{
+  this->Reset();
+
+  this->decoder_.DecompressFromBuffer(source, n);
+
+  // Checked before anything is written, the size
+  // read from the header is not trusted further
+  if (this->decoder_.GetOriginalSize() > capacity)
+  {
+    throw std::length_error("The decompressed content does not fit in the capacity");
+  }
+
+  this->decoder_.SetOutput(destination, capacity);
+  this->decoder_.Decode("offset");
+  this->decoder_.Decode("length");
+  this->decoder_.DecompressLZ77Code();
+
+  return this->decoder_.DecompressToBuffer(destination, capacity);
+}
+
+void LZ77::DecoderContext::SetDictionary(const Dictionary::Preset &dictionary)
+{
+  this->decoder_.SetDictionary(dictionary);
+}
+
+size_t LZ77::Compress(const void *source, size_t n,
+                      void *destination, size_t capacity)
+{
+  LZ77::EncoderContext context;
+
+  return context.Compress(source, n, destination, capacity);
+}
+
+uint64_t LZ77::DecompressedSize(const void *source, size_t n)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(source);
+  uint64_t original_size = 0;
+
+  // The bitstream header byte, then the original size
+  if (n < 9 || (bytes[0] & 0xF0) != 0xE0)
+  {
+    throw std::invalid_argument("Truncated .lz77 header");
+  }
+
+  for (int i = 1; i < 9; i++)
+  {
+    original_size = (original_size << 8) | bytes[i];
+  }
+
+  if (original_size & kDictionaryFlag)
+  {
+    original_size &= ~(kDictionaryFlag | kDictionaryTablesFlag);
+  }
+
+  return original_size;
+}
+
+size_t LZ77::Decompress(const void *source, size_t n,
+                        void *destination, size_t capacity)
+{
+  LZ77::DecoderContext context;
+
+  return context.Decompress(source, n, destination, capacity);
+}
+
+void LZ77::DecompressRange(std::string file_path, uint64_t offset,
+                           uint64_t length, std::ostream &output,
+                           const Dictionary::Preset &dictionary)
+{
+  std::ifstream input(file_path, std::ios::in | std::ios::binary);
+  LZ77::StreamDecoder lz77_decoder;
+
+  lz77_decoder.SetDictionary(dictionary);
+
+  if (!input)
+  {
+    throw std::invalid_argument("File not found");
+  }
+
+  lz77_decoder.DecompressRange(input, offset, length, output);
+}
+
+void LZ77::TestFile(std::string file_path, unsigned n_threads,
+                    const Dictionary::Preset &dictionary)
+{
+  std::ifstream input(file_path, std::ios::in | std::ios::binary);
+
+  if (!input)
+  {
+    throw std::invalid_argument("File not found");
+  }
+
+  uint8_t header_bytes[Frame::kFrameHeaderSize];
+
+  input.read(reinterpret_cast<char *>(header_bytes), Frame::kFrameHeaderSize);
+
+  if (input.gcount() != Frame::kFrameHeaderSize)
+  {
+    throw std::invalid_argument("The input is not a .lz77 file");
+  }
+
+  Frame::FrameHeader frame_header = Frame::ParseFrameHeader(header_bytes);
+  std::vector<Frame::IndexEntry> index;
+
+  if ((frame_header.flags & Frame::kBlockIndex) && n_threads > 1)
+  {
+    index = LZ77::StreamDecoder::ReadIndex(input, frame_header);
+  }
+
+  // Without an index the blocks can only be decoded in sequence,
+  // an empty index is a frame without blocks, the sequential
+  // decoder checks its end mark, checksum and index trailer
+  if (index.empty())
+  {
+    LZ77::StreamDecoder lz77_decoder;
+    std::ostream null_output(nullptr);
+
+    lz77_decoder.SetDictionary(dictionary);
+    input.clear();
+    input.seekg(0, std::ios::beg);
+    lz77_decoder.DecompressStream(input, null_output);
+
+    return;
+  }
+
+  // Every segment starts at a restart point, the threads
+  // take the next one not verified yet
+  std::vector<std::vector<uint64_t>> segment_checksums(index.size());
+  std::vector<std::string> segment_errors(index.size());
+  std::atomic<size_t> next_segment(0);
+  std::vector<std::thread> threads;
+
+  n_threads = std::min<size_t>(n_threads, index.size());
+
+  for (unsigned t = 0; t < n_threads; t++)
+  {
+    threads.emplace_back(
+        [&, t]()
+        {
+          std::ifstream segment_input(file_path, std::ios::in | std::ios::binary);
+          LZ77::StreamDecoder lz77_decoder;
+
+          lz77_decoder.SetDictionary(dictionary);
+          Trace::SetThreadName("test " + std::to_string(t));
+
+          for (size_t i = next_segment++; i < index.size(); i = next_segment++)
+          {
+            uint64_t raw_end = (i + 1 < index.size()) ? index[i + 1].raw_offset
+                                                      : UINT64_MAX;
+            Trace::Span span("verify segment");
+
+            span.Arg("segment", i);
+
+            try
+            {
+              segment_checksums[i] = lz77_decoder.VerifySegment(
+                  segment_input, frame_header, index[i], raw_end);
+            }
+
+            catch (const std::exception &error)
+            {
+              segment_errors[i] = error.what();
+            }
+          }
+        });
+  }
+
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  std::vector<uint64_t> block_checksums;
+
+  for (size_t i = 0; i < index.size(); i++)
+  {
+    if (!segment_errors[i].empty())
+    {
+      throw std::invalid_argument(segment_errors[i]);
+    }
+
+    block_checksums.insert(block_checksums.end(), segment_checksums[i].begin(),
+                           segment_checksums[i].end());
+  }
+
+  // The frame checksum follows the end mark, before the index
+  if (frame_header.flags & Frame::kContentChecksum)
+  {
+    uint8_t trailer_bytes[Frame::kIndexTrailerSize];
+    uint8_t checksum_bytes[Frame::kChecksumSize];
+
+    input.seekg(-(std::streamoff)Frame::kIndexTrailerSize, std::ios::end);
+    input.read(reinterpret_cast<char *>(trailer_bytes), Frame::kIndexTrailerSize);
+
+    uint64_t index_size = Frame::ReadUint(trailer_bytes + 4, 4);
+
+    input.seekg(-(std::streamoff)(index_size + Frame::kChecksumSize), std::ios::end);
+    input.read(reinterpret_cast<char *>(checksum_bytes), Frame::kChecksumSize);
+
+    if (!input || Frame::ReadUint(checksum_bytes, Frame::kChecksumSize) !=
+                      Frame::FrameChecksum(block_checksums))
+    {
+      throw std::invalid_argument("The .lz77 frame checksum does not match");
+    }
+  }
 }
@@ -1,35 +1,1059 @@
 #include <iostream>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "../include/lz77.h"
 #include "../include/huffman.h"
+#include "../include/fdstream.h"
+#include "../include/threadpool.h"
+#include "../include/benchmark.h"
+#include "../include/stats.h"
+#include "../include/trace.h"
+#include "../include/allocator.h"
+#include "../include/dictionary.h"
+
+// Exit codes
+static const int kExitOk = 0;
+static const int kExitError = 1;
+static const int kExitUsage = 2;
+
+static const std::string kSuffix = ".lz77";
+
+// Dictionary trained without -o
+static const std::string kDictionaryName = "dictionary";
+
+// Standard input or output file name
+static const std::string kStdName = "-";
+
+// Raw bytes of the segments large files are split
+// in, compressed by several workers at once
+static const uint64_t kSegmentSize = 8 * LZ77::StreamEncoder::kBlockSize;
+
+enum Mode
+{
+  kCompress,
+  kDecompress,
+  kTest,
+  kBenchmark,
+  kTrain
+};
+
+struct Options
+{
+  Mode mode = kCompress;
+  bool keep = false;
+  bool force = false;
+  bool recursive = false;
+  bool stats = false;
+  unsigned threads = 1;
+  uint64_t memory_budget = 0;
+  uint64_t restart_interval = kSegmentSize;
+  bool range = false;
+  uint64_t range_offset = 0;
+  uint64_t range_length = 0;
+  std::string output;
+  std::string trace;
+  std::string dictionary_name;
+  std::vector<std::string> files;
+  Benchmark::Settings benchmark;
+  Dictionary::TrainSettings train;
+  Dictionary::Preset dictionary;
+};
+
+// Input bytes read at once
+typedef std::vector<char, Allocator::Tracked<char, Allocator::kIOBuffers>> Chunk;
+
+// State each worker reuses from a file to the next
+struct WorkerContext
+{
+  Chunk chunk;
+  LZ77::StreamEncoder lz77_encoder;
+};
+
+// Blocks of a segment, their index and checksums
+// or the error that stopped them
+struct CompressedSegment
+{
+  LZ77::StreamEncoder::Segment blocks;
+  std::vector<uint8_t> compressed;
+  std::string error;
+};
+
+// Segments of a large file compressed apart. At most
+// as many as the reorder buffer slots are compressed
+// and not written at once, each one written starts
+// another. A task takes the first segment not taken,
+// so they start in order whatever the pool order.
+struct SegmentedFile
+{
+  std::string file_name;
+  std::string output_name;
+  size_t n_segments;
+  std::atomic<size_t> next_segment;
+  ThreadPool::ReorderBuffer<CompressedSegment> segments;
+  std::atomic<bool> failed;
+  std::string error;
+  bool std_output;
+  std::unique_ptr<FdStream::FdStreamBuf> output_buffer;
+  std::ostream output;
+  LZ77::StreamEncoder lz77_encoder;
+
+  SegmentedFile(size_t window)
+      : next_segment(0),
+        segments(window),
+        failed(false),
+        std_output(false),
+        output(nullptr)
+  {
+  }
+};
+
+// Serializes the messages of the workers
+static std::mutex report_mutex;
+static std::atomic<int> exit_code(kExitOk);
+
+static void ReportError(const std::string &file_name, const std::string &message)
+{
+  std::lock_guard<std::mutex> lock(report_mutex);
+
+  std::cerr << file_name << ": " << message << "\n";
+  exit_code = kExitError;
+}
+
+static void ReportOk(const std::string &file_name)
+{
+  std::lock_guard<std::mutex> lock(report_mutex);
+
+  std::cout << file_name << ": OK\n";
+}
+
+static void PrintUsage()
+{
+  std::cerr << "Usage: ./LZ77 [-c | -d | -t] [-k] [-f] [-r] [-T threads] [-M budget] [-D dictionary] [-o output] [--stats=json] [--trace=file] [file...]\n"
+            << "       ./LZ77 -b [-i runs] [-B block_size]... [file or directory...]\n"
+            << "       ./LZ77 -d --range=offset:length [-o output] file.lz77\n"
+            << "       ./LZ77 --train [-f] [-T threads] [--maxdict=size] [-o dictionary] sample...\n"
+            << "  -c  compress file to file.lz77 (default)\n"
+            << "  -d  decompress file.lz77 to file\n"
+            << "  -t  test file.lz77 integrity\n"
+            << "  -b  benchmark in memory, " << Benchmark::kDefaultCorpus << " by default\n"
+            << "  -i  benchmark timed runs (default 3)\n"
+            << "  -B  benchmark block size, K and M suffixes allowed, repeatable\n"
+            << "  -k  keep the input file\n"
+            << "  -f  overwrite existing output files\n"
+            << "  -r  process the files found in directories\n"
+            << "  -T  worker threads, 0 for one per core (default 1)\n"
+            << "  -M  memory budget, K and M suffixes allowed (default none)\n"
+            << "  -D  preset dictionary, trained by --train, to compress, decompress or test with\n"
+            << "  -o  output file name, for a single input\n"
+            << "  --stats=json  print the codec counters to stderr at exit\n"
+            << "  --trace=file  write a Chrome trace of the threads and stages\n"
+            << "  --restart=size  raw bytes between the restart points the block index\n"
+            << "                  points to, 0 for the first block only (default 8M)\n"
+            << "  --range=offset:length  decompress only these bytes, K and M suffixes allowed\n"
+            << "  --train  train a dictionary from the samples, and directories of them,\n"
+            << "           to " << kDictionaryName << " by default\n"
+            << "  --maxdict=size  trained dictionary size (default " << Dictionary::kDefaultSize
+            << ", at most " << Dictionary::kMaxSize << ")\n"
+            << "Without files, or with -, stdin is read and stdout written.\n";
+}
+
+// Parses a decimal number with an optional K or M
+// suffix, returns false if value is not one
+static bool ParseSize(const std::string &value, uint64_t &size)
+{
+  size_t digits = std::min(value.find_first_not_of("0123456789"), value.size());
+  std::string suffix = value.substr(digits);
+
+  if (digits == 0 || digits > 9 ||
+      (suffix != "" && suffix != "K" && suffix != "M"))
+  {
+    return false;
+  }
+
+  size = std::stoull(value.substr(0, digits));
+  size <<= suffix == "K" ? 10 : suffix == "M" ? 20 : 0;
+
+  return true;
+}
+
+// Returns false on an invalid command line
+static bool ParseOptions(int argc, char *argv[], Options &options)
+{
+  bool options_end = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (options_end || arg.size() < 2 || arg[0] != '-')
+    {
+      options.files.push_back(arg);
+      continue;
+    }
+
+    if (arg == "--")
+    {
+      options_end = true;
+      continue;
+    }
+
+    if (arg.compare(0, 8, "--stats=") == 0)
+    {
+      if (arg.substr(8) != "json")
+      {
+        return false;
+      }
+
+      options.stats = true;
+      continue;
+    }
+
+    if (arg.compare(0, 10, "--restart=") == 0)
+    {
+      if (!ParseSize(arg.substr(10), options.restart_interval))
+      {
+        return false;
+      }
+
+      continue;
+    }
+
+    if (arg.compare(0, 8, "--range=") == 0)
+    {
+      size_t colon = arg.find(':');
+
+      if (colon == std::string::npos ||
+          !ParseSize(arg.substr(8, colon - 8), options.range_offset) ||
+          !ParseSize(arg.substr(colon + 1), options.range_length))
+      {
+        return false;
+      }
+
+      options.range = true;
+      continue;
+    }
+
+    if (arg == "--train")
+    {
+      options.mode = kTrain;
+      continue;
+    }
+
+    if (arg.compare(0, 10, "--maxdict=") == 0)
+    {
+      uint64_t size;
+
+      if (!ParseSize(arg.substr(10), size) || size == 0 || size > Dictionary::kMaxSize)
+      {
+        return false;
+      }
+
+      options.train.dictionary_size = size;
+      continue;
+    }
+
+    if (arg.compare(0, 8, "--trace=") == 0)
+    {
+      options.trace = arg.substr(8);
+
+      if (options.trace.empty())
+      {
+        return false;
+      }
+
+      continue;
+    }
+
+    // Flags may be grouped, as in -dk
+    for (size_t j = 1; j < arg.size(); j++)
+    {
+      std::string value;
+
+      // The value is the rest of the flag or the next argument
+      if (arg[j] == 'o' || arg[j] == 'T' || arg[j] == 'i' || arg[j] == 'B' ||
+          arg[j] == 'M' || arg[j] == 'D')
+      {
+        if (j + 1 < arg.size())
+        {
+          value = arg.substr(j + 1);
+        }
+        else if (i + 1 < argc)
+        {
+          value = argv[++i];
+        }
+        else
+        {
+          return false;
+        }
+      }
+
+      switch (arg[j])
+      {
+      case 'c':
+        options.mode = kCompress;
+        break;
+      case 'd':
+        options.mode = kDecompress;
+        break;
+      case 't':
+        options.mode = kTest;
+        break;
+      case 'k':
+        options.keep = true;
+        break;
+      case 'f':
+        options.force = true;
+        break;
+      case 'r':
+        options.recursive = true;
+        break;
+      case 'b':
+        options.mode = kBenchmark;
+        break;
+      case 'o':
+        options.output = value;
+        j = arg.size();
+        break;
+      case 'D':
+        options.dictionary_name = value;
+        j = arg.size();
+        break;
+      case 'T':
+        if (value.empty() || value.size() > 4 ||
+            value.find_first_not_of("0123456789") != std::string::npos)
+        {
+          return false;
+        }
+        options.threads = std::stoul(value);
+        j = arg.size();
+        break;
+      case 'i':
+      {
+        uint64_t iterations;
+
+        if (!ParseSize(value, iterations) || iterations == 0 ||
+            iterations > 1000)
+        {
+          return false;
+        }
+        options.benchmark.iterations = iterations;
+        j = arg.size();
+        break;
+      }
+      case 'B':
+      {
+        uint64_t block_size;
+
+        if (!ParseSize(value, block_size) || block_size == 0 ||
+            block_size > UINT32_MAX)
+        {
+          return false;
+        }
+        options.benchmark.block_sizes.push_back(block_size);
+        j = arg.size();
+        break;
+      }
+      case 'M':
+        if (!ParseSize(value, options.memory_budget) || options.memory_budget == 0)
+        {
+          return false;
+        }
+        j = arg.size();
+        break;
+      default:
+        return false;
+      }
+    }
+  }
+
+  if (options.threads == 0)
+  {
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // A range is read from a single seekable file
+  if (options.range && (options.mode != kDecompress || options.files.size() != 1 ||
+                        options.files[0] == kStdName))
+  {
+    return false;
+  }
+
+  // Dictionaries are used by the file modes alone
+  if (!options.dictionary_name.empty() &&
+      (options.mode == kBenchmark || options.mode == kTrain))
+  {
+    return false;
+  }
+
+  // Samples are not read from stdin
+  if (options.mode == kTrain)
+  {
+    options.train.threads = options.threads;
+
+    return !options.files.empty();
+  }
+
+  if (options.files.empty())
+  {
+    options.files.push_back(options.mode == kBenchmark ? Benchmark::kDefaultCorpus
+                                                       : kStdName);
+  }
+
+  if (!options.output.empty() && options.files.size() > 1)
+  {
+    return false;
+  }
+
+  return true;
+}
+
+static bool HasSuffix(const std::string &file_name)
+{
+  return file_name.size() > kSuffix.size() &&
+         file_name.compare(file_name.size() - kSuffix.size(),
+                           kSuffix.size(), kSuffix) == 0;
+}
+
+// Replaces directories by the files found in them,
+// the ones the mode does not apply to are skipped
+static std::vector<std::string> ExpandFiles(const Options &options)
+{
+  std::vector<std::string> files;
+
+  for (const auto &file_name : options.files)
+  {
+    std::error_code error;
+
+    if (!options.recursive || file_name == kStdName ||
+        !std::filesystem::is_directory(file_name, error))
+    {
+      files.push_back(file_name);
+      continue;
+    }
+
+    for (auto it = std::filesystem::recursive_directory_iterator(file_name, error);
+         it != std::filesystem::recursive_directory_iterator();
+         it.increment(error))
+    {
+      if (!it->is_regular_file(error))
+      {
+        continue;
+      }
+
+      std::string path = it->path().string();
+
+      if (HasSuffix(path) == (options.mode != kCompress))
+      {
+        files.push_back(path);
+      }
+    }
+
+    if (error)
+    {
+      ReportError(file_name, error.message());
+    }
+  }
+
+  return files;
+}
+
+static bool FileExists(const std::string &file_name)
+{
+  std::ifstream file(file_name);
+
+  return file.good();
+}
+
+// Reads up to n bytes, returns the number read
+static size_t ReadChunk(std::istream &input, Chunk &chunk, size_t n)
+{
+  Trace::Span span("read");
+
+  input.read(chunk.data(), n);
+
+  return input.gcount();
+}
+
+static void WriteBytes(std::ostream &output, const std::vector<uint8_t> &bytes)
+{
+  Trace::Span span("write");
+
+  output.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+static void CompressFile(std::istream &input, std::ostream &output,
+                         const Options &options, WorkerContext &context)
+{
+  LZ77::StreamEncoder &lz77_encoder = context.lz77_encoder;
+
+  // The index lets -t and --range start at restart points
+  lz77_encoder.SetBlockIndex(true);
+  lz77_encoder.SetRestartInterval(options.restart_interval);
+  lz77_encoder.SetDictionary(options.dictionary);
+
+  // Pushes the input in chunks, writing
+  // the blocks as they are compressed
+  Chunk &chunk = context.chunk;
+  size_t n;
+
+  chunk.resize(LZ77::StreamEncoder::kBlockSize);
+
+  WriteBytes(output, lz77_encoder.Begin());
+
+  while ((n = ReadChunk(input, chunk, chunk.size())) > 0)
+  {
+    WriteBytes(output, lz77_encoder.Update(chunk.data(), n));
+  }
+
+  WriteBytes(output, lz77_encoder.End());
+}
+
+// Ends the file once its last segment is written
+static void FinishSegmentedFile(SegmentedFile &file, const Options &options)
+{
+  if (file.error.empty())
+  {
+    try
+    {
+      WriteBytes(file.output, file.lz77_encoder.End());
+      file.output.flush();
+
+      if (!file.output || !file.output_buffer->Close())
+      {
+        file.error = "write error";
+      }
+    }
+    catch (const std::exception &error)
+    {
+      file.error = error.what();
+    }
+  }
+
+  // Partial outputs are not left behind
+  if (!file.error.empty())
+  {
+    ReportError(file.file_name, file.error);
+
+    if (!file.std_output)
+    {
+      file.output_buffer->Close();
+      std::remove(file.output_name.c_str());
+    }
+
+    return;
+  }
+
+  if (!options.keep && !file.std_output)
+  {
+    std::remove(file.file_name.c_str());
+  }
+}
+
+static void CompressSegment(std::shared_ptr<SegmentedFile> file,
+                            const Options &options, ThreadPool::WorkStealingPool &pool,
+                            std::vector<WorkerContext> &contexts);
+
+// Writes a segment after the previous ones and
+// starts another while segments are left
+static void WriteSegment(std::shared_ptr<SegmentedFile> file, size_t segment,
+                         CompressedSegment &compressed, const Options &options,
+                         ThreadPool::WorkStealingPool &pool,
+                         std::vector<WorkerContext> &contexts)
+{
+  if (file->error.empty() && !compressed.error.empty())
+  {
+    file->error = compressed.error;
+    file->failed = true;
+  }
+
+  // Pool tasks must not throw, the error is the file's
+  if (file->error.empty())
+  {
+    try
+    {
+      WriteBytes(file->output, compressed.compressed);
+      file->lz77_encoder.AppendSegment(compressed.blocks);
+
+      // The segments left are not compressed for nothing
+      if (!file->output)
+      {
+        throw std::invalid_argument("write error");
+      }
+    }
+    catch (const std::exception &error)
+    {
+      file->error = error.what();
+      file->failed = true;
+    }
+  }
+
+  if (segment + file->segments.Capacity() < file->n_segments)
+  {
+    pool.Submit([file, &options, &pool, &contexts]()
+                { CompressSegment(file, options, pool, contexts); });
+  }
+
+  if (segment + 1 == file->n_segments)
+  {
+    FinishSegmentedFile(*file, options);
+  }
+}
+
+// Compresses the next segment of a large file
+static void CompressSegment(std::shared_ptr<SegmentedFile> file,
+                            const Options &options, ThreadPool::WorkStealingPool &pool,
+                            std::vector<WorkerContext> &contexts)
+{
+  WorkerContext &context = contexts[ThreadPool::WorkStealingPool::WorkerIndex()];
+  size_t segment = file->next_segment++;
+  CompressedSegment compressed;
+
+  // The segments after a failed one are not compressed
+  if (!file->failed)
+  {
+    Trace::Span span("segment");
+    std::ifstream input(file->file_name, std::ios::in | std::ios::binary);
+    std::vector<uint8_t> &output = compressed.compressed;
+    uint64_t remaining = kSegmentSize;
+    size_t n;
+
+    span.Label(file->file_name);
+    span.Arg("segment", segment);
+    input.seekg(segment * kSegmentSize, std::ios::beg);
+
+    try
+    {
+      // The worker encoder and its encoders serve
+      // every segment, Begin forgets the previous one
+      LZ77::StreamEncoder &lz77_encoder = context.lz77_encoder;
+
+      lz77_encoder.SetRestartInterval(options.restart_interval);
+      lz77_encoder.SetDictionary(options.dictionary);
+      context.chunk.resize(LZ77::StreamEncoder::kBlockSize);
+
+      // The segment frame header is not written
+      lz77_encoder.Begin();
+
+      while (remaining > 0 &&
+             (n = ReadChunk(input, context.chunk,
+                            std::min<uint64_t>(remaining, context.chunk.size()))) > 0)
+      {
+        std::vector<uint8_t> blocks =
+            lz77_encoder.Update(context.chunk.data(), n);
+
+        output.insert(output.end(), blocks.begin(), blocks.end());
+        remaining -= n;
+      }
+
+      std::vector<uint8_t> blocks = lz77_encoder.Flush();
+
+      output.insert(output.end(), blocks.begin(), blocks.end());
+      compressed.blocks = lz77_encoder.TakeSegment();
+
+      if (!input && !input.eof())
+      {
+        compressed.error = "read error";
+      }
+    }
+
+    // Reported when the segment turn to be written comes,
+    // out of memory and over the budget as well
+    catch (const std::exception &error)
+    {
+      compressed.error = error.what();
+    }
+  }
+
+  // Whoever finds the oldest segments
+  // done writes them, in order
+  file->segments.Put(segment, std::move(compressed),
+                     [&](uint64_t ready, CompressedSegment &ready_segment)
+                     { WriteSegment(file, ready, ready_segment, options, pool, contexts); });
+}
+
+// Runs the selected mode on a file
+static void ProcessFile(const Options &options, const std::string &file_name,
+                        ThreadPool::WorkStealingPool &pool,
+                        std::vector<WorkerContext> &contexts)
+{
+  WorkerContext &context = contexts[ThreadPool::WorkStealingPool::WorkerIndex()];
+  bool std_input = file_name == kStdName;
+  Trace::Span span("file");
+
+  span.Label(file_name);
+
+  if (options.mode == kTest)
+  {
+    try
+    {
+      // Stdin can not be seeked, its blocks are tested in sequence
+      if (std_input)
+      {
+        FdStream::FdStreamBuf input_buffer(STDIN_FILENO);
+        std::istream input(&input_buffer);
+        std::ostream null_output(nullptr);
+        LZ77::StreamDecoder lz77_decoder;
+
+        lz77_decoder.SetDictionary(options.dictionary);
+        lz77_decoder.DecompressStream(input, null_output);
+      }
+
+      // A single file gets every worker, many files
+      // are already tested by several at once
+      else
+      {
+        LZ77::TestFile(file_name, options.files.size() == 1 ? options.threads : 1,
+                       options.dictionary);
+      }
+    }
+
+    catch (const std::exception &error)
+    {
+      ReportError(file_name, error.what());
+      return;
+    }
+
+    ReportOk(file_name);
+    return;
+  }
+
+  std::string output_name = options.output;
+
+  if (output_name.empty())
+  {
+    if (std_input)
+    {
+      output_name = kStdName;
+    }
+
+    else if (options.mode == kCompress && HasSuffix(file_name) && !options.force)
+    {
+      ReportError(file_name, "already has " + kSuffix + " suffix");
+      return;
+    }
+
+    else if (options.mode == kCompress)
+    {
+      output_name = file_name + kSuffix;
+    }
+
+    else if (HasSuffix(file_name))
+    {
+      output_name = file_name.substr(0, file_name.size() - kSuffix.size());
+    }
+
+    else
+    {
+      ReportError(file_name, "unknown suffix, use -o");
+      return;
+    }
+  }
+
+  bool std_output = output_name == kStdName;
+
+  // Compressed data is not written to a terminal
+  if (std_output && options.mode == kCompress && !options.force &&
+      isatty(STDOUT_FILENO))
+  {
+    ReportError(kStdName, "compressed data not written to a terminal, use -f");
+    return;
+  }
+
+  // Files and the standard streams go through the same
+  // buffers, read ahead and written behind by an I/O queue
+  std::unique_ptr<FdStream::FdStreamBuf> input_buffer;
+  std::unique_ptr<FdStream::FdStreamBuf> output_buffer;
+  uint64_t file_size = 0;
+
+  if (std_input)
+  {
+    input_buffer.reset(new FdStream::FdStreamBuf(STDIN_FILENO));
+  }
+
+  else
+  {
+    int input_fd = open(file_name.c_str(), O_RDONLY);
+    struct stat input_stat;
+
+    if (input_fd < 0)
+    {
+      ReportError(file_name, "File not found");
+      return;
+    }
+
+    if (fstat(input_fd, &input_stat) == 0)
+    {
+      file_size = input_stat.st_size;
+    }
+
+    input_buffer.reset(new FdStream::FdStreamBuf(input_fd, FdStream::kBufferSize, true));
+  }
+
+  if (!std_output && !options.force && FileExists(output_name))
+  {
+    ReportError(output_name, "already exists, use -f");
+    return;
+  }
+
+  // Large files are split in segments compressed
+  // by every worker, written by the last one done
+  if (options.mode == kCompress && !std_input &&
+      pool.Size() > 1 && file_size > kSegmentSize)
+  {
+    auto file = std::make_shared<SegmentedFile>(2 * pool.Size());
+
+    file->file_name = file_name;
+    file->output_name = output_name;
+    file->n_segments = (file_size + kSegmentSize - 1) / kSegmentSize;
+    file->std_output = std_output;
+
+    // Written behind through the same buffers as a single
+    // stream, by whichever worker writes the next segment
+    if (std_output)
+    {
+      file->output_buffer.reset(new FdStream::FdStreamBuf(STDOUT_FILENO));
+    }
+
+    else
+    {
+      int output_fd = open(output_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+      if (output_fd < 0)
+      {
+        ReportError(output_name, "could not be created");
+        return;
+      }
+
+      file->output_buffer.reset(
+          new FdStream::FdStreamBuf(output_fd, FdStream::kBufferSize, true));
+    }
+
+    file->output.rdbuf(file->output_buffer.get());
+
+    // Every segment starts at a restart point of the index
+    file->lz77_encoder.SetBlockIndex(true);
+    file->lz77_encoder.SetDictionary(options.dictionary);
+    WriteBytes(file->output, file->lz77_encoder.Begin());
+
+    // The first window of segments, the
+    // others start as these are written
+    for (size_t i = 0; i < std::min(file->n_segments, file->segments.Capacity()); i++)
+    {
+      pool.Submit([file, &options, &pool, &contexts]()
+                  { CompressSegment(file, options, pool, contexts); });
+    }
+
+    return;
+  }
+
+  if (std_output)
+  {
+    output_buffer.reset(new FdStream::FdStreamBuf(STDOUT_FILENO));
+  }
+
+  else
+  {
+    int output_fd = open(output_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (output_fd < 0)
+    {
+      ReportError(output_name, "could not be created");
+      return;
+    }
+
+    output_buffer.reset(new FdStream::FdStreamBuf(output_fd, FdStream::kBufferSize, true));
+  }
+
+  std::istream input(input_buffer.get());
+  std::ostream output(output_buffer.get());
+
+  try
+  {
+    if (options.mode == kCompress)
+    {
+      CompressFile(input, output, options, context);
+    }
+
+    else if (options.range)
+    {
+      LZ77::DecompressRange(file_name, options.range_offset,
+                            options.range_length, output, options.dictionary);
+    }
+
+    else
+    {
+      LZ77::StreamDecoder lz77_decoder;
+
+      lz77_decoder.SetDictionary(options.dictionary);
+      lz77_decoder.DecompressStream(input, output);
+    }
+
+    output.flush();
+
+    if (!output || !output_buffer->Close())
+    {
+      throw std::invalid_argument("write error");
+    }
+  }
+
+  // Partial outputs are not left behind
+  catch (const std::exception &error)
+  {
+    ReportError(file_name, error.what());
+
+    if (!std_output)
+    {
+      output_buffer->Close();
+      std::remove(output_name.c_str());
+    }
+
+    return;
+  }
+
+  // Inputs written to stdout are kept, as with gzip -c,
+  // and so are the ones a range was taken from
+  if (!options.keep && !options.range && !std_input && !std_output)
+  {
+    input_buffer->Close();
+    std::remove(file_name.c_str());
+  }
+}
+
+// Trains a dictionary from the samples, the
+// files and the files found in the directories
+static void TrainDictionary(const Options &options)
+{
+  std::string output_name = options.output.empty() ? kDictionaryName : options.output;
+  std::vector<std::pair<std::string, std::string>> corpus;
+  std::vector<std::string> samples;
+
+  if (!options.force && FileExists(output_name))
+  {
+    ReportError(output_name, "already exists, use -f");
+    return;
+  }
+
+  if (!Benchmark::LoadCorpus(options.files, corpus))
+  {
+    exit_code = kExitError;
+    return;
+  }
+
+  for (auto &file : corpus)
+  {
+    samples.push_back(std::move(file.second));
+  }
+
+  try
+  {
+    Dictionary::Save(Dictionary::Train(samples, options.train), output_name);
+  }
+  catch (const std::exception &error)
+  {
+    ReportError(output_name, error.what());
+    return;
+  }
+
+  ReportOk(output_name);
+}
 
 int main(int argc, char *argv[])
 {
+  Options options;
 
-  LZ77::Encoder *lz77_encoder = new LZ77::Encoder();
-  LZ77::Decoder *lz77_decoder = new LZ77::Decoder();
+  if (!ParseOptions(argc, argv, options))
+  {
+    PrintUsage();
+    return kExitUsage;
+  }
 
-  if(argc < 2)
+  if (!options.trace.empty())
   {
-    throw std::invalid_argument("Less than 2 arguments");
+    Trace::Start();
   }
 
-  char *file_name = argv[1];
-  char *out_file = argv[2];
-  std::string compressed_file = out_file;
-  compressed_file += ".lz77";
+  Allocator::SetBudget(options.memory_budget);
 
-  std::string decompressed_file = out_file;
-  decompressed_file += ".decompressed";
+  // Files are measured one at a time, so
+  // the other workers do not skew the times
+  if (options.mode == kBenchmark)
+  {
+    if (!Benchmark::Run(options.files, options.benchmark))
+    {
+      exit_code = kExitError;
+    }
+  }
+
+  else if (options.mode == kTrain)
+  {
+    TrainDictionary(options);
+  }
+
+  // Every file is a task, a failed
+  // one does not stop the others
+  else
+  {
+    options.files = ExpandFiles(options);
+
+    if (!options.dictionary_name.empty())
+    {
+      try
+      {
+        options.dictionary = Dictionary::Load(options.dictionary_name);
+      }
+      catch (const std::exception &error)
+      {
+        ReportError(options.dictionary_name, error.what());
+        return exit_code;
+      }
+    }
+
+    ThreadPool::WorkStealingPool pool(options.threads);
+    std::vector<WorkerContext> contexts(pool.Size());
 
-  lz77_encoder->FillBuffer(file_name);
-  lz77_encoder->Encode();
-  lz77_encoder->CompressToFile(compressed_file);
+    // A single worker leaves a core to entropy code
+    // a block while it parses the next one
+    if (pool.Size() == 1 && std::thread::hardware_concurrency() > 1)
+    {
+      contexts[0].lz77_encoder.SetPipeline(true);
+    }
 
-  lz77_decoder->DecompressFromFile(compressed_file);
-  lz77_decoder->Decode("offset");
-  lz77_decoder->Decode("length");
-  lz77_decoder->DecompressLZ77Code();
-  lz77_decoder->DecompressToFile(decompressed_file);
+    for (const auto &file_name : options.files)
+    {
+      // Pool tasks must not throw, what escapes
+      // the file steps fails the file alone
+      pool.Submit([&, file_name]()
+                  {
+                    try
+                    {
+                      ProcessFile(options, file_name, pool, contexts);
+                    }
+                    catch (const std::exception &error)
+                    {
+                      ReportError(file_name, error.what());
+                    }
+                  });
+    }
+
+    pool.Wait();
+  }
+
+  // The workers ended, their counters are merged
+  if (options.stats)
+  {
+    Stats::WriteJson(std::cerr);
+  }
+
+  if (!options.trace.empty() && !Trace::Write(options.trace))
+  {
+    ReportError(options.trace, "write error");
+  }
 
-  return 0;
-}
\ No newline at end of file
+  return exit_code;
+}
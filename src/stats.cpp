@@ -0,0 +1,243 @@
+#include "../include/stats.h"
+#include "../include/allocator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+static const char *const kStageNames[Stats::kStageCount] = {
+    "parse", "tables", "write", "checksum", "decode", "output"};
+
+// Counters of the running threads, and the sum
+// of the counters of the threads already ended
+struct CountersRegistry
+{
+  std::mutex mutex;
+  std::vector<Stats::Counters *> running;
+  Stats::Counters ended;
+};
+
+static CountersRegistry &GetRegistry()
+{
+  static CountersRegistry registry;
+
+  return registry;
+}
+
+// Registers the thread counters while it runs
+struct ThreadCounters
+{
+  Stats::Counters counters;
+
+  ThreadCounters()
+  {
+    CountersRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.running.push_back(&this->counters);
+  }
+
+  ~ThreadCounters()
+  {
+    CountersRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.ended.Merge(this->counters);
+    registry.running.erase(std::find(registry.running.begin(),
+                                     registry.running.end(),
+                                     &this->counters));
+  }
+};
+
+static uint64_t NowNanoseconds()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Stats::Counters::Merge(const Counters &other)
+{
+  this->encoded_blocks += other.encoded_blocks;
+  this->reused_tables += other.reused_tables;
+  this->encoded_bytes += other.encoded_bytes;
+  this->positions += other.positions;
+  this->probes += other.probes;
+  this->depth_total += other.depth_total;
+  this->depth_max = std::max(this->depth_max, other.depth_max);
+  this->literal_triples += other.literal_triples;
+  this->matched_bytes += other.matched_bytes;
+
+  for (int i = 0; i < kLengthBuckets; i++)
+  {
+    this->length_histogram[i] += other.length_histogram[i];
+  }
+
+  for (int i = 0; i < kOffsetBuckets; i++)
+  {
+    this->offset_histogram[i] += other.offset_histogram[i];
+  }
+
+  this->header_bits += other.header_bits;
+  this->offset_bits += other.offset_bits;
+  this->length_bits += other.length_bits;
+  this->literal_bits += other.literal_bits;
+  this->offset_entropy_bits += other.offset_entropy_bits;
+  this->length_entropy_bits += other.length_entropy_bits;
+
+  this->decoded_blocks += other.decoded_blocks;
+  this->decoded_bytes += other.decoded_bytes;
+  this->decoded_triples += other.decoded_triples;
+  this->copied_bytes += other.copied_bytes;
+
+  for (int i = 0; i < kStageCount; i++)
+  {
+    this->stage_ns[i] += other.stage_ns[i];
+  }
+}
+
+Stats::Counters &Stats::Local()
+{
+  thread_local ThreadCounters thread_counters;
+
+  return thread_counters.counters;
+}
+
+Stats::Counters Stats::Collect()
+{
+  CountersRegistry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  Counters total = registry.ended;
+
+  for (const Counters *counters : registry.running)
+  {
+    total.Merge(*counters);
+  }
+
+  return total;
+}
+
+void Stats::RecordTriple(Counters &counters, int offset, int length)
+{
+  int offset_bucket = 0;
+
+  while (offset_bucket < kOffsetBuckets - 1 && (offset >> offset_bucket) != 0)
+  {
+    offset_bucket++;
+  }
+
+  counters.positions++;
+  counters.matched_bytes += length;
+  counters.literal_triples += length == 0;
+  counters.length_histogram[std::min(length, kLengthBuckets - 1)]++;
+  counters.offset_histogram[offset_bucket]++;
+}
+
+int Stats::EnterStage(int stage)
+{
+  Counters &counters = Local();
+  uint64_t now = NowNanoseconds();
+  int previous = counters.stage;
+
+  if (previous >= 0)
+  {
+    counters.stage_ns[previous] += now - counters.stage_begin;
+  }
+
+  counters.stage = stage;
+  counters.stage_begin = now;
+
+  return previous;
+}
+
+static void WriteArray(std::ostream &output, const uint64_t *values, int n)
+{
+  output << "[";
+
+  for (int i = 0; i < n; i++)
+  {
+    output << (i > 0 ? "," : "") << values[i];
+  }
+
+  output << "]";
+}
+
+static double Ratio(double numerator, double denominator)
+{
+  return denominator > 0 ? numerator / denominator : 0;
+}
+
+void Stats::WriteJson(std::ostream &output)
+{
+  Counters counters = Collect();
+  uint64_t payload_bits = counters.header_bits + counters.offset_bits +
+                          counters.length_bits + counters.literal_bits;
+
+  output << "{\n"
+         << "  \"enabled\": " << (kEnabled ? "true" : "false") << ",\n"
+         << "  \"encoder\": {\n"
+         << "    \"blocks\": " << counters.encoded_blocks << ",\n"
+         << "    \"reused_tables\": " << counters.reused_tables << ",\n"
+         << "    \"raw_bytes\": " << counters.encoded_bytes << ",\n"
+         << "    \"triples\": " << counters.positions << ",\n"
+         << "    \"probes\": " << counters.probes << ",\n"
+         << "    \"probes_per_position\": "
+         << Ratio(counters.probes, counters.positions) << ",\n"
+         << "    \"depth_mean\": "
+         << Ratio(counters.depth_total, counters.positions) << ",\n"
+         << "    \"depth_max\": " << counters.depth_max << ",\n"
+         << "    \"literal_triples\": " << counters.literal_triples << ",\n"
+         << "    \"matched_bytes\": " << counters.matched_bytes << ",\n"
+         << "    \"literal_ratio\": "
+         << Ratio(counters.positions,
+                  counters.positions + counters.matched_bytes)
+         << ",\n"
+         << "    \"length_histogram\": ";
+  WriteArray(output, counters.length_histogram, kLengthBuckets);
+  output << ",\n"
+         << "    \"offset_log2_histogram\": ";
+  WriteArray(output, counters.offset_histogram, kOffsetBuckets);
+  output << ",\n"
+         << "    \"bits\": {\"header\": " << counters.header_bits
+         << ", \"offset\": " << counters.offset_bits
+         << ", \"length\": " << counters.length_bits
+         << ", \"literal\": " << counters.literal_bits
+         << ", \"total\": " << payload_bits << "},\n"
+         << "    \"entropy_bits\": {\"offset\": " << counters.offset_entropy_bits
+         << ", \"length\": " << counters.length_entropy_bits << "}\n"
+         << "  },\n"
+         << "  \"decoder\": {\n"
+         << "    \"blocks\": " << counters.decoded_blocks << ",\n"
+         << "    \"raw_bytes\": " << counters.decoded_bytes << ",\n"
+         << "    \"triples\": " << counters.decoded_triples << ",\n"
+         << "    \"copied_bytes\": " << counters.copied_bytes << "\n"
+         << "  },\n";
+
+  // Accounted bytes, kept with or without the counters
+  Allocator::Usage usage = Allocator::GetUsage();
+
+  output << "  \"memory\": {\n"
+         << "    \"budget\": " << usage.budget << ",\n"
+         << "    \"current\": " << usage.total_current << ",\n"
+         << "    \"peak\": " << usage.total_peak;
+
+  for (int i = 0; i < Allocator::kSubsystemCount; i++)
+  {
+    output << ",\n    \"" << Allocator::kSubsystemNames[i]
+           << "\": {\"current\": " << usage.current[i]
+           << ", \"peak\": " << usage.peak[i] << "}";
+  }
+
+  output << "\n  },\n"
+         << "  \"stage_seconds\": {";
+
+  for (int i = 0; i < kStageCount; i++)
+  {
+    output << (i > 0 ? ", " : "") << "\"" << kStageNames[i] << "\": "
+           << counters.stage_ns[i] / 1e9;
+  }
+
+  output << "}\n"
+         << "}\n";
+}
@@ -0,0 +1,174 @@
+#include "../include/threadpool.h"
+#include "../include/trace.h"
+
+#include <algorithm>
+
+// Index of the worker running in this thread
+static thread_local int worker_index = -1;
+
+// Pool owning the worker running in this thread
+static thread_local const ThreadPool::WorkStealingPool *worker_pool = nullptr;
+
+ThreadPool::WorkStealingPool::WorkStealingPool(size_t n_workers)
+    : pending_(0),
+      queued_(0),
+      next_queue_(0),
+      stop_(false)
+{
+  n_workers = std::max<size_t>(n_workers, 1);
+
+  for (size_t i = 0; i < n_workers; i++)
+  {
+    this->queues_.emplace_back(new WorkerQueue());
+  }
+
+  for (size_t i = 0; i < n_workers; i++)
+  {
+    this->workers_.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::WorkStealingPool::~WorkStealingPool()
+{
+  this->Wait();
+
+  {
+    std::lock_guard<std::mutex> lock(this->sleep_mutex_);
+    this->stop_ = true;
+  }
+
+  this->work_available_.notify_all();
+
+  for (auto &worker : this->workers_)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPool::WorkStealingPool::Submit(Task task)
+{
+  size_t queue;
+
+  // Subtasks stay with their worker, the
+  // rest is spread over every worker
+  if (worker_pool == this)
+  {
+    queue = worker_index;
+  }
+
+  else
+  {
+    queue = this->next_queue_++ % this->queues_.size();
+  }
+
+  this->pending_++;
+
+  {
+    std::lock_guard<std::mutex> lock(this->queues_[queue]->mutex);
+    this->queues_[queue]->tasks.push_back(std::move(task));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->sleep_mutex_);
+    this->queued_++;
+  }
+
+  this->work_available_.notify_one();
+}
+
+bool ThreadPool::WorkStealingPool::PopTask(size_t worker, Task &task)
+{
+  // Own deque, newest task first
+  {
+    WorkerQueue &own = *this->queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+
+    if (!own.tasks.empty())
+    {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  // Other deques, oldest task first
+  for (size_t i = 1; i < this->queues_.size(); i++)
+  {
+    WorkerQueue &victim = *this->queues_[(worker + i) % this->queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+
+    if (!victim.tasks.empty())
+    {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::WorkStealingPool::WorkerLoop(size_t worker)
+{
+  worker_index = worker;
+  worker_pool = this;
+
+  Trace::SetThreadName("worker " + std::to_string(worker));
+
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(this->sleep_mutex_);
+
+      this->work_available_.wait(
+          lock, [this]()
+          { return this->stop_ || this->queued_ > 0; });
+
+      if (this->queued_ == 0)
+      {
+        return;
+      }
+
+      this->queued_--;
+    }
+
+    // A task is queued for this worker, in
+    // its deque or in one it can steal from
+    Task task;
+
+    while (!this->PopTask(worker, task))
+    {
+      std::this_thread::yield();
+    }
+
+    {
+      Trace::Span span("task");
+
+      task();
+    }
+
+    if (--this->pending_ == 0)
+    {
+      std::lock_guard<std::mutex> lock(this->sleep_mutex_);
+      this->all_done_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::WorkStealingPool::Wait()
+{
+  std::unique_lock<std::mutex> lock(this->sleep_mutex_);
+
+  this->all_done_.wait(lock, [this]()
+                       { return this->pending_ == 0; });
+}
+
+size_t ThreadPool::WorkStealingPool::Size() const
+{
+  return this->workers_.size();
+}
+
+int ThreadPool::WorkStealingPool::WorkerIndex()
+{
+  return worker_index;
+}
@@ -0,0 +1,253 @@
+#include "../include/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+static std::atomic<bool> enabled(false);
+static std::atomic<uint64_t> epoch(0);
+
+// Spans of a thread, written by it alone
+struct ThreadBuffer
+{
+  int tid;
+  std::string name;
+  std::vector<Trace::Event> events;
+};
+
+// Buffers of the running threads, and
+// the buffers of the threads already ended
+struct BufferRegistry
+{
+  std::mutex mutex;
+  int next_tid = 0;
+  std::vector<ThreadBuffer *> running;
+  std::vector<ThreadBuffer> ended;
+};
+
+static BufferRegistry &GetRegistry()
+{
+  static BufferRegistry registry;
+
+  return registry;
+}
+
+// Registers the thread buffer while it runs
+struct LocalBuffer
+{
+  ThreadBuffer buffer;
+
+  LocalBuffer()
+  {
+    BufferRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    this->buffer.tid = registry.next_tid++;
+    this->buffer.name = "thread " + std::to_string(this->buffer.tid);
+    registry.running.push_back(&this->buffer);
+  }
+
+  ~LocalBuffer()
+  {
+    BufferRegistry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.running.erase(std::find(registry.running.begin(),
+                                     registry.running.end(),
+                                     &this->buffer));
+    registry.ended.push_back(std::move(this->buffer));
+  }
+};
+
+static ThreadBuffer &GetBuffer()
+{
+  thread_local LocalBuffer local_buffer;
+
+  return local_buffer.buffer;
+}
+
+static uint64_t NowNanoseconds()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Writes a JSON string, escaped
+static void WriteString(std::ostream &output, const std::string &text)
+{
+  output << '"';
+
+  for (unsigned char c : text)
+  {
+    if (c == '"' || c == '\\')
+    {
+      output << '\\' << c;
+    }
+
+    else if (c < 0x20)
+    {
+      char escaped[8];
+
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      output << escaped;
+    }
+
+    else
+    {
+      output << c;
+    }
+  }
+
+  output << '"';
+}
+
+static void WriteEvents(std::ostream &output, const ThreadBuffer &buffer,
+                        bool &first)
+{
+  output << (first ? "" : ",\n")
+         << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+         << buffer.tid << ",\"args\":{\"name\":";
+  WriteString(output, buffer.name);
+  output << "}}";
+  first = false;
+
+  for (const auto &event : buffer.events)
+  {
+    output << ",\n{\"name\":\"" << event.name
+           << "\",\"cat\":\"lz77\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.tid
+           << ",\"ts\":" << event.begin / 1e3
+           << ",\"dur\":" << (event.end - event.begin) / 1e3
+           << ",\"args\":{";
+
+    const char *separator = "";
+
+    for (int i = 0; i < 2; i++)
+    {
+      if (event.arg_names[i] != nullptr)
+      {
+        output << separator << "\"" << event.arg_names[i] << "\":" << event.args[i];
+        separator = ",";
+      }
+    }
+
+    if (!event.label.empty())
+    {
+      output << separator << "\"file\":";
+      WriteString(output, event.label);
+    }
+
+    output << "}}";
+  }
+}
+
+void Trace::Start()
+{
+  epoch = NowNanoseconds();
+  enabled = true;
+
+  GetBuffer().name = "main";
+}
+
+bool Trace::Enabled()
+{
+  return enabled.load(std::memory_order_relaxed);
+}
+
+void Trace::SetThreadName(const std::string &name)
+{
+  if (Trace::Enabled())
+  {
+    GetBuffer().name = name;
+  }
+}
+
+bool Trace::Write(const std::string &file_path)
+{
+  BufferRegistry &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::ofstream output(file_path, std::ios::out | std::ios::trunc);
+  bool first = true;
+
+  output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+  for (const auto &buffer : registry.ended)
+  {
+    WriteEvents(output, buffer, first);
+  }
+
+  for (const ThreadBuffer *buffer : registry.running)
+  {
+    WriteEvents(output, *buffer, first);
+  }
+
+  output << "\n]}\n";
+  output.close();
+
+  return bool(output);
+}
+
+Trace::Span::Span(const char *name)
+    : enabled_(Trace::Enabled())
+{
+  if (this->enabled_)
+  {
+    this->event_.name = name;
+    this->event_.begin = NowNanoseconds() - epoch;
+    this->event_.arg_names[0] = nullptr;
+    this->event_.arg_names[1] = nullptr;
+  }
+}
+
+Trace::Span::~Span()
+{
+  this->Close();
+}
+
+void Trace::Span::Close()
+{
+  if (this->enabled_)
+  {
+    this->event_.end = NowNanoseconds() - epoch;
+    GetBuffer().events.push_back(std::move(this->event_));
+  }
+}
+
+void Trace::Span::Arg(const char *name, uint64_t value)
+{
+  if (!this->enabled_)
+  {
+    return;
+  }
+
+  int i = this->event_.arg_names[0] == nullptr ? 0 : 1;
+
+  this->event_.arg_names[i] = name;
+  this->event_.args[i] = value;
+}
+
+void Trace::Span::Label(const std::string &label)
+{
+  if (this->enabled_)
+  {
+    this->event_.label = label;
+  }
+}
+
+void Trace::Span::Switch(const char *name)
+{
+  this->Close();
+
+  if (this->enabled_)
+  {
+    this->event_.name = name;
+    this->event_.begin = this->event_.end;
+    this->event_.arg_names[0] = nullptr;
+    this->event_.arg_names[1] = nullptr;
+    this->event_.label.clear();
+  }
+}
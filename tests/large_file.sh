@@ -0,0 +1,30 @@
+#!/bin/sh
+# Round trip of a content larger than 4 GiB, through the
+# file sizes, positions and block offsets past 32 bits.
+# It compresses at the codec speed, so it takes a while.
+#
+# Usage: tests/large_file.sh [size_in_bytes]
+
+set -e
+
+LZ77=${LZ77:-./LZ77}
+SIZE=${1:-4395630592}
+DIR=$(mktemp -d)
+
+trap 'rm -rf "$DIR"' EXIT
+
+# Mostly zeros, written sparse, with a marker every GiB
+truncate -s "$SIZE" "$DIR/large"
+
+for offset in 0 1073741824 2147483648 3221225472 4294967296; do
+  if [ "$offset" -lt "$SIZE" ]; then
+    printf 'marker %s' "$offset" | dd of="$DIR/large" bs=1 seek="$offset" conv=notrunc status=none
+  fi
+done
+
+"$LZ77" -c -k -T0 -o "$DIR/large.lz77" "$DIR/large"
+"$LZ77" -t -T0 "$DIR/large.lz77"
+"$LZ77" -d -k -o "$DIR/large.out" "$DIR/large.lz77"
+
+cmp "$DIR/large" "$DIR/large.out"
+echo "large_file: OK"
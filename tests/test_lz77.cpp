@@ -0,0 +1,823 @@
+// Checks of the codec, the formats and the subsystems around it
+//
+// Usage: ./test_lz77
+//
+// Every check prints its failures, the exit code is the
+// number of failed checks. make check builds and runs it.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../include/lz77.h"
+#include "../include/frame.h"
+#include "../include/checksum.h"
+#include "../include/threadpool.h"
+#include "../include/fdstream.h"
+#include "../include/asyncio.h"
+#include "../include/dictionary.h"
+
+static int n_failures = 0;
+
+#define CHECK(condition)                                              \
+  do                                                                  \
+  {                                                                   \
+    if (!(condition))                                                 \
+    {                                                                 \
+      fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+      n_failures++;                                                   \
+    }                                                                 \
+  } while (0)
+
+// True if body throws an Exception
+template <typename Exception>
+static bool Throws(const std::function<void()> &body)
+{
+  try
+  {
+    body();
+  }
+  catch (const Exception &)
+  {
+    return true;
+  }
+
+  return false;
+}
+
+// Empty contents decompress to 0 bytes, too small
+// capacities are told apart from them
+static void TestInMemoryCapacity()
+{
+  std::string message = "capacity capacity capacity";
+  std::vector<uint8_t> compressed(LZ77::CompressBound(message.size()));
+  std::vector<uint8_t> output(message.size());
+  size_t compressed_size = LZ77::Compress(message.data(), message.size(),
+                                          compressed.data(), compressed.size());
+
+  CHECK(LZ77::DecompressedSize(compressed.data(), compressed_size) == message.size());
+  CHECK(Throws<std::length_error>([&]()
+                                  { LZ77::Decompress(compressed.data(), compressed_size,
+                                                     output.data(), output.size() - 1); }));
+  CHECK(LZ77::Decompress(compressed.data(), compressed_size,
+                         output.data(), output.size()) == message.size());
+
+  compressed.assign(LZ77::CompressBound(0), 0);
+  compressed_size = LZ77::Compress("", 0, compressed.data(), compressed.size());
+
+  CHECK(compressed_size > 0);
+  CHECK(LZ77::Decompress(compressed.data(), compressed_size, output.data(), 0) == 0);
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { LZ77::DecompressedSize(compressed.data(), 4); }));
+
+  // Buffers without a bitstream header byte are rejected, not half read
+  compressed[0] = 0x00;
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { LZ77::Decompress(compressed.data(), compressed_size,
+                                                         output.data(), output.size()); }));
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { LZ77::Decompress(compressed.data(), 0,
+                                                         output.data(), output.size()); }));
+}
+
+// Text with repeats near and far, matches of every offset size
+static std::string SampleText(size_t size)
+{
+  static const char *kWords[] = {"lz77 ", "offset ", "length ", "literal ",
+                                 "aaaaaaaa", "window ", "\n", "0123456789"};
+  std::string text;
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+
+  while (text.size() < size)
+  {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    text += kWords[state % 8];
+  }
+
+  text.resize(size);
+
+  return text;
+}
+
+// Match copies of every short offset and length give
+// the bytes a byte by byte copy gives
+static void TestCopyMatch()
+{
+  for (size_t offset = 1; offset <= 40; offset++)
+  {
+    for (size_t length = 0; length <= 80; length++)
+    {
+      std::vector<uint8_t> copied(offset + length + LZ77::kWildCopySlack);
+      std::vector<uint8_t> expected(offset + length);
+
+      for (size_t i = 0; i < offset; i++)
+      {
+        copied[i] = expected[i] = uint8_t(i * 7 + 1);
+      }
+
+      for (size_t i = offset; i < offset + length; i++)
+      {
+        expected[i] = expected[i - offset];
+      }
+
+      LZ77::CopyMatch(copied.data() + offset, offset, length);
+
+      CHECK(std::equal(expected.begin(), expected.end(), copied.begin()));
+    }
+  }
+}
+
+// Every single bit flip of a content is decompressed or
+// rejected, corrupted matches never hang the decoder
+static void TestInMemoryCorruption()
+{
+  std::string message = SampleText(300);
+  std::vector<uint8_t> compressed(LZ77::CompressBound(message.size()));
+  std::vector<uint8_t> output(4 * message.size());
+  size_t compressed_size = LZ77::Compress(message.data(), message.size(),
+                                          compressed.data(), compressed.size());
+  LZ77::DecoderContext context;
+
+  for (size_t bit = 8; bit < 8 * compressed_size; bit++)
+  {
+    compressed[bit / 8] ^= 1 << (bit % 8);
+
+    try
+    {
+      context.Decompress(compressed.data(), compressed_size,
+                         output.data(), output.size());
+    }
+    catch (const std::exception &)
+    {
+    }
+
+    compressed[bit / 8] ^= 1 << (bit % 8);
+  }
+
+  CHECK(context.Decompress(compressed.data(), compressed_size, output.data(),
+                           output.size()) == message.size());
+  CHECK(std::memcmp(output.data(), message.data(), message.size()) == 0);
+}
+
+// Frame of content compressed in blocks of block_size,
+// with a block index when restart_interval is not 0
+static std::string CompressFrame(const std::string &content, size_t block_size,
+                                 uint64_t restart_interval = 0,
+                                 const Dictionary::Preset &dictionary = Dictionary::Preset())
+{
+  LZ77::StreamEncoder lz77_encoder(block_size);
+
+  lz77_encoder.SetBlockIndex(restart_interval != 0);
+  lz77_encoder.SetRestartInterval(restart_interval);
+  lz77_encoder.SetDictionary(dictionary);
+
+  std::vector<uint8_t> frame = lz77_encoder.Begin();
+  std::vector<uint8_t> blocks = lz77_encoder.Update(content.data(), content.size());
+  std::vector<uint8_t> end = lz77_encoder.End();
+
+  frame.insert(frame.end(), blocks.begin(), blocks.end());
+  frame.insert(frame.end(), end.begin(), end.end());
+
+  return std::string(frame.begin(), frame.end());
+}
+
+// Content of a frame, as the streaming decoder writes it
+static std::string DecompressFrame(const std::string &frame,
+                                   const Dictionary::Preset &dictionary = Dictionary::Preset())
+{
+  LZ77::StreamDecoder lz77_decoder;
+  std::istringstream input(frame);
+  std::ostringstream output;
+
+  lz77_decoder.SetDictionary(dictionary);
+  lz77_decoder.DecompressStream(input, output);
+
+  return output.str();
+}
+
+// Every single bit flip of a frame is decompressed or
+// rejected by the streaming decoder, which -t also uses
+static void TestFrameCorruption()
+{
+  std::string content = SampleText(1500);
+  std::string frame = CompressFrame(content, 512);
+
+  for (size_t bit = 0; bit < 8 * frame.size(); bit++)
+  {
+    frame[bit / 8] ^= 1 << (bit % 8);
+
+    try
+    {
+      DecompressFrame(frame);
+    }
+    catch (const std::exception &)
+    {
+    }
+
+    frame[bit / 8] ^= 1 << (bit % 8);
+  }
+
+  CHECK(DecompressFrame(frame) == content);
+}
+
+// Frames of any content and block size decompress to
+// it, and every truncation of them is rejected
+static void TestFrameRoundTrip()
+{
+  for (size_t size : {0, 1, 100, 5000})
+  {
+    std::string content = SampleText(size);
+
+    for (size_t block_size : {1, 64, 4096})
+    {
+      CHECK(DecompressFrame(CompressFrame(content, block_size)) == content);
+    }
+  }
+
+  std::string frame = CompressFrame(SampleText(2000), 256, 512);
+
+  for (size_t n = 0; n < frame.size(); n++)
+  {
+    CHECK(Throws<std::invalid_argument>([&]()
+                                        { DecompressFrame(frame.substr(0, n)); }));
+  }
+}
+
+// Headers parse back to what was written, and a frame is
+// the blocks its headers describe, restart blocks in the index
+static void TestFrameFormat()
+{
+  std::vector<uint8_t> bytes;
+  Frame::FrameHeader frame_header;
+
+  frame_header.version = Frame::kVersion;
+  frame_header.flags = Frame::kContentChecksum | Frame::kDictionary;
+  frame_header.block_size = 123456;
+  frame_header.dictionary_id = 0xCAFEBABE;
+  Frame::WriteFrameHeader(frame_header, bytes);
+
+  CHECK(bytes.size() == Frame::FrameHeaderSize(frame_header.flags));
+
+  Frame::FrameHeader parsed = Frame::ParseFrameHeader(bytes.data());
+
+  CHECK(parsed.flags == frame_header.flags && parsed.block_size == 123456);
+  CHECK(Frame::ParseDictionaryId(bytes.data() + Frame::kFrameHeaderSize) == 0xCAFEBABE);
+
+  bytes[0] ^= 1;
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { Frame::ParseFrameHeader(bytes.data()); }));
+
+  Frame::BlockHeader block_header = {1000, 300, Frame::kRestart, 0x0123456789ABCDEFULL};
+
+  bytes.clear();
+  Frame::WriteBlockHeader(block_header, Frame::kContentChecksum, bytes);
+
+  CHECK(bytes.size() == Frame::BlockHeaderSize(Frame::kContentChecksum));
+
+  Frame::BlockHeader parsed_block = Frame::ParseBlockHeader(bytes.data(),
+                                                            Frame::kContentChecksum);
+
+  CHECK(parsed_block.raw_size == 1000 && parsed_block.compressed_size == 300 &&
+        parsed_block.flags == Frame::kRestart &&
+        parsed_block.checksum == block_header.checksum);
+
+  // A periodic content codes the same triples in every
+  // block, which reuse the first block tables
+  std::string content;
+
+  while (content.size() < 8000)
+  {
+    content += "0123456789";
+  }
+
+  std::string frame = CompressFrame(content, 512, 2048);
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(frame.data());
+  Frame::FrameHeader header = Frame::ParseFrameHeader(data);
+  size_t position = Frame::FrameHeaderSize(header.flags);
+  size_t header_size = Frame::BlockHeaderSize(header.flags);
+  uint64_t raw_offset = 0;
+  std::vector<Frame::IndexEntry> restarts;
+  bool reused = false;
+
+  CHECK(header.flags == (Frame::kBlockIndex | Frame::kContentChecksum));
+
+  while (Frame::ReadUint(data + position, Frame::kEndMarkSize) != 0)
+  {
+    Frame::BlockHeader block = Frame::ParseBlockHeader(data + position, header.flags);
+
+    if (block.flags & Frame::kRestart)
+    {
+      restarts.push_back({raw_offset, position});
+    }
+
+    reused |= (block.flags & Frame::kReuseTables) != 0;
+    CHECK(block.checksum ==
+          Checksum::XXH64(content.data() + raw_offset, block.raw_size));
+
+    raw_offset += block.raw_size;
+    position += header_size + block.compressed_size;
+  }
+
+  CHECK(raw_offset == content.size());
+  CHECK(reused);
+  CHECK(restarts.size() == 4);
+
+  // End mark, frame checksum, then the index
+  position += Frame::kEndMarkSize + Frame::kChecksumSize;
+
+  std::vector<Frame::IndexEntry> index = Frame::ParseIndex(data + position,
+                                                           restarts.size());
+
+  CHECK(position + restarts.size() * Frame::kIndexEntrySize +
+            Frame::kIndexTrailerSize == frame.size());
+
+  for (size_t i = 0; i < restarts.size() && i < index.size(); i++)
+  {
+    CHECK(index[i].raw_offset == restarts[i].raw_offset);
+    CHECK(index[i].compressed_offset == restarts[i].compressed_offset);
+  }
+
+  // Ranges start at the restart points and end anywhere
+  std::istringstream input(frame);
+
+  for (uint64_t offset : {0, 1, 2047, 2048, 5000, 7999})
+  {
+    std::ostringstream range;
+    LZ77::StreamDecoder lz77_decoder;
+
+    input.clear();
+    lz77_decoder.DecompressRange(input, offset, 1000, range);
+
+    CHECK(range.str() == content.substr(offset, 1000));
+  }
+
+  // An empty content has an index without entries, tested
+  // in sequence whatever the threads number
+  std::string empty_frame = CompressFrame("", 512, 2048);
+  char file_name[] = "/tmp/test_lz77_XXXXXX";
+  int fd = mkstemp(file_name);
+
+  CHECK(write(fd, empty_frame.data(), empty_frame.size()) ==
+        (ssize_t)empty_frame.size());
+  CHECK(!Throws<std::exception>([&]()
+                                { LZ77::TestFile(file_name, 4); }));
+
+  // The frame checksum of no blocks is still checked
+  empty_frame[Frame::FrameHeaderSize(Frame::kBlockIndex) + Frame::kEndMarkSize] ^= 1;
+  CHECK(pwrite(fd, empty_frame.data(), empty_frame.size(), 0) ==
+        (ssize_t)empty_frame.size());
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { LZ77::TestFile(file_name, 4); }));
+
+  close(fd);
+  unlink(file_name);
+}
+
+// XXH64 of reference vectors, in one call and in pieces
+static void TestChecksum()
+{
+  CHECK(Checksum::XXH64("", 0) == 0xEF46DB3751D8E999ULL);
+  CHECK(Checksum::XXH64("a", 1) == 0xD24EC4F1A98C6E5BULL);
+  CHECK(Checksum::XXH64("abc", 3) == 0x44BC2CF5AD770999ULL);
+
+  std::string content = SampleText(1000);
+
+  for (size_t split : {0, 1, 31, 32, 33, 500, 1000})
+  {
+    Checksum::XXH64State state;
+
+    state.Update(content.data(), split);
+    state.Update(content.data() + split, content.size() - split);
+
+    CHECK(state.Digest() == Checksum::XXH64(content.data(), content.size()));
+  }
+}
+
+// Flushed blocks end where the content pushed so far
+// ends, and the stream goes on after them
+static void TestStreamFlush()
+{
+  std::string content = SampleText(3000);
+  LZ77::StreamEncoder lz77_encoder(1024);
+  std::vector<uint8_t> frame = lz77_encoder.Begin();
+
+  for (size_t position = 0; position < content.size(); position += 700)
+  {
+    size_t n = std::min<size_t>(700, content.size() - position);
+    std::vector<uint8_t> blocks = lz77_encoder.Update(content.data() + position, n);
+    std::vector<uint8_t> flushed = lz77_encoder.Flush();
+
+    frame.insert(frame.end(), blocks.begin(), blocks.end());
+    frame.insert(frame.end(), flushed.begin(), flushed.end());
+  }
+
+  std::vector<uint8_t> end = lz77_encoder.End();
+
+  frame.insert(frame.end(), end.begin(), end.end());
+
+  CHECK(DecompressFrame(std::string(frame.begin(), frame.end())) == content);
+}
+
+// Segments compressed one after the other by the same stream,
+// as a worker does, append to a frame indexed across them
+static void TestStreamSegments()
+{
+  std::string content = SampleText(7000);
+  LZ77::StreamEncoder lz77_encoder(512);
+  LZ77::StreamEncoder segment_encoder(512);
+
+  lz77_encoder.SetBlockIndex(true);
+  segment_encoder.SetRestartInterval(1024);
+
+  std::vector<uint8_t> frame = lz77_encoder.Begin();
+
+  for (size_t position = 0; position < content.size(); position += 3000)
+  {
+    size_t n = std::min<size_t>(3000, content.size() - position);
+
+    segment_encoder.Begin();
+
+    std::vector<uint8_t> blocks = segment_encoder.Update(content.data() + position, n);
+    std::vector<uint8_t> flushed = segment_encoder.Flush();
+
+    frame.insert(frame.end(), blocks.begin(), blocks.end());
+    frame.insert(frame.end(), flushed.begin(), flushed.end());
+    lz77_encoder.AppendSegment(segment_encoder.TakeSegment());
+  }
+
+  std::vector<uint8_t> end = lz77_encoder.End();
+
+  frame.insert(frame.end(), end.begin(), end.end());
+
+  std::string frame_bytes(frame.begin(), frame.end());
+  std::istringstream input(frame_bytes);
+  Frame::FrameHeader frame_header;
+
+  CHECK(DecompressFrame(frame_bytes) == content);
+  CHECK(LZ77::StreamDecoder::ReadIndex(input, frame_header).size() == 7);
+
+  for (uint64_t offset : {0, 2990, 3000, 5000, 6100})
+  {
+    std::ostringstream range;
+    LZ77::StreamDecoder lz77_decoder;
+
+    input.clear();
+    lz77_decoder.DecompressRange(input, offset, 500, range);
+
+    CHECK(range.str() == content.substr(offset, 500));
+  }
+}
+
+// Items put in any order by many threads are written
+// in sequence, each one once
+static void TestReorderBuffer()
+{
+  const size_t kItems = 1000;
+  ThreadPool::ReorderBuffer<size_t> reorder_buffer(8);
+  ThreadPool::WorkStealingPool pool(4);
+  std::vector<size_t> written;
+  std::atomic<size_t> next(0);
+
+  // At most the capacity is in flight: each task puts the
+  // next sequence, each write starts another task
+  std::function<void()> put = [&]()
+  {
+    size_t sequence = next++;
+
+    reorder_buffer.Put(sequence, sequence * 3,
+                       [&](uint64_t ready, size_t &item)
+                       {
+                         written.push_back(item);
+
+                         if (ready + reorder_buffer.Capacity() < kItems)
+                         {
+                           pool.Submit(put);
+                         }
+                       });
+  };
+
+  for (size_t i = 0; i < reorder_buffer.Capacity(); i++)
+  {
+    pool.Submit(put);
+  }
+
+  pool.Wait();
+
+  CHECK(written.size() == kItems);
+
+  for (size_t i = 0; i < written.size(); i++)
+  {
+    CHECK(written[i] == i * 3);
+  }
+}
+
+// Tasks, and the tasks they submit, all run on the workers
+static void TestWorkStealingPool()
+{
+  ThreadPool::WorkStealingPool pool(3);
+  std::atomic<uint64_t> sum(0);
+  std::atomic<int> outside(0);
+
+  CHECK(pool.Size() == 3);
+  CHECK(ThreadPool::WorkStealingPool::WorkerIndex() == -1);
+
+  for (uint64_t i = 1; i <= 100; i++)
+  {
+    pool.Submit([&, i]()
+                {
+                  int worker = ThreadPool::WorkStealingPool::WorkerIndex();
+
+                  if (worker < 0 || worker >= 3)
+                  {
+                    outside++;
+                  }
+
+                  sum += i;
+                  pool.Submit([&, i]()
+                              { sum += 1000 * i; });
+                });
+  }
+
+  pool.Wait();
+
+  CHECK(sum == 5050 + 1000 * 5050);
+  CHECK(outside == 0);
+}
+
+// Bytes written through an FdStream buffer are read back
+// by another, with either I/O backend
+static void TestFdStream()
+{
+  std::string content = SampleText(3 * 100000 + 17);
+
+  for (AsyncIO::Backend backend : {AsyncIO::kUring, AsyncIO::kThread})
+  {
+    char file_name[] = "/tmp/test_lz77_XXXXXX";
+    int fd = mkstemp(file_name);
+
+    AsyncIO::SetBackend(backend);
+    CHECK(fd >= 0);
+
+    {
+      // Small buffers, so the writes go behind many times
+      FdStream::FdStreamBuf output_buffer(fd, 4096, true);
+      std::ostream output(&output_buffer);
+
+      output.write(content.data(), 1000);
+      output.write(content.data() + 1000, content.size() - 1000);
+      output.flush();
+
+      CHECK(output && output_buffer.Close());
+    }
+
+    {
+      FdStream::FdStreamBuf input_buffer(open(file_name, O_RDONLY), 4096, true);
+      std::istream input(&input_buffer);
+      std::ostringstream read;
+
+      read << input.rdbuf();
+
+      CHECK(read.str() == content);
+    }
+
+    // A compressed frame goes through them as well
+    {
+      int pipe_fds[2];
+
+      CHECK(pipe(pipe_fds) == 0);
+
+      std::string frame = CompressFrame(SampleText(5000), 1024);
+      std::thread writer([&]()
+                         {
+                           FdStream::FdStreamBuf output_buffer(pipe_fds[1], 512, true);
+                           std::ostream output(&output_buffer);
+
+                           output.write(frame.data(), frame.size());
+                           output.flush();
+                           output_buffer.Close();
+                         });
+
+      FdStream::FdStreamBuf input_buffer(pipe_fds[0], 512, true);
+      std::istream input(&input_buffer);
+      std::ostringstream decompressed;
+      LZ77::StreamDecoder lz77_decoder;
+
+      lz77_decoder.DecompressStream(input, decompressed);
+      writer.join();
+
+      CHECK(decompressed.str() == SampleText(5000));
+    }
+
+    unlink(file_name);
+  }
+
+  AsyncIO::SetBackend(AsyncIO::kUring);
+}
+
+// Dictionaries go through their file format unchanged, are
+// trained from samples, and are needed by what they coded
+static void TestDictionary()
+{
+  std::vector<std::string> samples;
+
+  for (size_t i = 0; i < 200; i++)
+  {
+    samples.push_back("{\"id\": " + std::to_string(i) +
+                      ", \"name\": \"sample\", \"text\": \"" + SampleText(40 + i % 30) +
+                      "\"}");
+  }
+
+  Dictionary::TrainSettings settings;
+
+  settings.dictionary_size = 1024;
+  settings.threads = 2;
+
+  Dictionary::Preset dictionary = Dictionary::Train(samples, settings);
+
+  CHECK(!dictionary.content.empty() && dictionary.content.size() <= 1024);
+  CHECK(dictionary.id != 0);
+  CHECK(!dictionary.offset_table.empty() && !dictionary.length_table.empty());
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { Dictionary::Train({}, settings); }));
+
+  std::vector<uint8_t> bytes;
+
+  Dictionary::Serialize(dictionary, bytes);
+
+  Dictionary::Preset parsed = Dictionary::Parse(bytes.data(), bytes.size());
+
+  CHECK(parsed.id == dictionary.id && parsed.content == dictionary.content);
+  CHECK(parsed.offset_table == dictionary.offset_table);
+  CHECK(parsed.length_table == dictionary.length_table);
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { Dictionary::Parse(bytes.data(), bytes.size() / 2); }));
+
+  char file_name[] = "/tmp/test_lz77_XXXXXX";
+  int fd = mkstemp(file_name);
+
+  close(fd);
+  Dictionary::Save(dictionary, file_name);
+  CHECK(Dictionary::Load(file_name).content == dictionary.content);
+  unlink(file_name);
+
+  // Messages through the contexts, smaller with the dictionary
+  LZ77::EncoderContext encoder_context;
+  LZ77::DecoderContext decoder_context;
+  LZ77::DecoderContext plain_decoder_context;
+  std::vector<uint8_t> compressed(LZ77::CompressBound(200));
+  std::vector<uint8_t> output(200);
+  size_t plain_size = 0, dictionary_size = 0;
+
+  for (const std::string &message : samples)
+  {
+    plain_size += LZ77::Compress(message.data(), message.size(),
+                                 compressed.data(), compressed.size());
+  }
+
+  encoder_context.SetDictionary(dictionary);
+  decoder_context.SetDictionary(dictionary);
+
+  for (const std::string &message : samples)
+  {
+    size_t compressed_size = encoder_context.Compress(message.data(), message.size(),
+                                                      compressed.data(),
+                                                      compressed.size());
+
+    dictionary_size += compressed_size;
+
+    CHECK(decoder_context.Decompress(compressed.data(), compressed_size,
+                                     output.data(), output.size()) == message.size());
+    CHECK(std::memcmp(output.data(), message.data(), message.size()) == 0);
+    CHECK(Throws<std::invalid_argument>([&]()
+                                        { plain_decoder_context.Decompress(
+                                              compressed.data(), compressed_size,
+                                              output.data(), output.size()); }));
+  }
+
+  CHECK(dictionary_size < plain_size);
+
+  // Frames with the dictionary before their restart points
+  std::string content;
+
+  for (const std::string &message : samples)
+  {
+    content += message;
+  }
+
+  std::string frame = CompressFrame(content, 1024, 4096, dictionary);
+
+  CHECK(frame.size() < CompressFrame(content, 1024, 4096).size());
+  CHECK(DecompressFrame(frame, dictionary) == content);
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { DecompressFrame(frame); }));
+
+  Dictionary::Preset other = Dictionary::Create("other", 5);
+
+  CHECK(Throws<std::invalid_argument>([&]()
+                                      { DecompressFrame(frame, other); }));
+
+  std::istringstream input(frame);
+  std::ostringstream range;
+  LZ77::StreamDecoder lz77_decoder;
+
+  lz77_decoder.SetDictionary(dictionary);
+  lz77_decoder.DecompressRange(input, 5000, 3000, range);
+
+  CHECK(range.str() == content.substr(5000, 3000));
+}
+
+// Sizes and positions past 4 GiB are not truncated to 32 bits
+static void TestLargeSizes()
+{
+  const uint64_t kLarge = (uint64_t(1) << 32) + 10;
+  std::vector<uint8_t> bytes;
+
+  Frame::WriteUint(kLarge, 8, bytes);
+  CHECK(bytes.size() == 8 && Frame::ReadUint(bytes.data(), 8) == kLarge);
+
+  std::vector<Frame::IndexEntry> index = {{kLarge, 3 * kLarge}};
+
+  bytes.clear();
+  Frame::WriteIndex(index, bytes);
+
+  std::vector<Frame::IndexEntry> parsed = Frame::ParseIndex(bytes.data(), 1);
+
+  CHECK(parsed[0].raw_offset == kLarge && parsed[0].compressed_offset == 3 * kLarge);
+
+  // A content claiming 4 GiB and 10 bytes does not fit 100 bytes,
+  // as its 10 low bytes would
+  std::string message = "0123456789";
+  std::vector<uint8_t> compressed(LZ77::CompressBound(message.size()));
+  std::vector<uint8_t> output(100);
+  size_t compressed_size = LZ77::Compress(message.data(), message.size(),
+                                          compressed.data(), compressed.size());
+
+  std::vector<uint8_t> size_bytes;
+
+  // The size follows the bitstream header byte
+  Frame::WriteUint(kLarge, 8, size_bytes);
+  std::copy(size_bytes.begin(), size_bytes.end(), compressed.begin() + 1);
+
+  CHECK(LZ77::DecompressedSize(compressed.data(), compressed_size) == kLarge);
+  CHECK(Throws<std::length_error>([&]()
+                                  { LZ77::Decompress(compressed.data(), compressed_size,
+                                                     output.data(), output.size()); }));
+
+  // Nothing is allocated from the claimed size, far
+  // more than the memory, before it is checked
+  size_bytes.clear();
+  Frame::WriteUint(uint64_t(1) << 61, 8, size_bytes);
+  std::copy(size_bytes.begin(), size_bytes.end(), compressed.begin() + 1);
+
+  CHECK(Throws<std::length_error>([&]()
+                                  { LZ77::Decompress(compressed.data(), compressed_size,
+                                                     output.data(), output.size()); }));
+  CHECK(!Throws<std::bad_alloc>([&]()
+                                {
+                                  try
+                                  {
+                                    LZ77::Decompress(compressed.data(), compressed_size,
+                                                     output.data(), output.size());
+                                  }
+                                  catch (const std::length_error &)
+                                  {
+                                  }
+                                }));
+}
+
+int main()
+{
+  TestLargeSizes();
+  TestInMemoryCapacity();
+  TestCopyMatch();
+  TestInMemoryCorruption();
+  TestFrameCorruption();
+  TestFrameRoundTrip();
+  TestFrameFormat();
+  TestChecksum();
+  TestStreamFlush();
+  TestStreamSegments();
+  TestReorderBuffer();
+  TestWorkStealingPool();
+  TestFdStream();
+  TestDictionary();
+
+  if (n_failures == 0)
+  {
+    printf("All checks passed\n");
+  }
+
+  return n_failures;
+}